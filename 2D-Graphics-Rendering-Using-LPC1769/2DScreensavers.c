@@ -12,6 +12,7 @@
 #include <NXP/crp.h>
 #include "LPC17xx.h"                        /* LPC17xx definitions */
 #include "ssp.h"
+#include "fixmath.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -37,6 +38,17 @@ uint8_t dest_addr[SSP_BUFSIZE];
 #define ST7735_SLPOUT 0x11
 #define ST7735_DISPON 0x29
 
+/* SPI bit rate for the LCD link, the ST7735 write cycle is at least 66 ns */
+#define LCD_SPI_HZ 15000000
+
+/* Screensavers draw one square or tree per frame at FRAME_RATE frames a
+   second, paced by SysTick. A frame that overruns its slot skips the slots
+   it ran into. FRAME_STATS prints the frame rate, skipped slots and draw
+   time once a screensaver is done. */
+#define FRAME_RATE 10
+#define FRAME_STATS 1
+#define FRAME_TICK_HZ 1000
+
 
 
 #define swap(x, y) {x = x + y; y = x - y; x = x - y ;}
@@ -74,8 +86,6 @@ uint8_t dest_addr[SSP_BUFSIZE];
 int _height = ST7735_TFTHEIGHT;
 int _width = ST7735_TFTWIDTH;
 
-#define pi 3.1416
-
 /* Define a structure for a Point object */
 typedef struct Point
 {
@@ -83,18 +93,18 @@ typedef struct Point
 	float y;
 }Point;
 
-/* Write to the target device using SSP protocol */
-void spiwrite(uint8_t c)
+/* Write bytes to the target device using SSP protocol, streamed through the FIFO under one SSEL */
+void spiwrite(const uint8_t *buf, uint32_t len)
 
 {
 
  int pnum = 0;
 
- src_addr[0] = c;
-
  SSP_SSELToggle( pnum, 0 );
 
- SSPSend( pnum, (uint8_t *)src_addr, 1 );
+ SSPStreamSend( pnum, buf, len );
+
+ SSPStreamFlush( pnum );
 
  SSP_SSELToggle( pnum, 1 );
 
@@ -108,7 +118,7 @@ void writecommand(uint8_t c)
 
  LPC_GPIO0->FIOCLR |= (0x1<<3);
 
- spiwrite(c);
+ spiwrite(&c, 1);
 
 }
 
@@ -120,73 +130,104 @@ void writedata(uint8_t c)
 
  LPC_GPIO0->FIOSET |= (0x1<<3);
 
- spiwrite(c);
+ spiwrite(&c, 1);
 
 }
 
 
-/* Write word to the LCD using SSP Protocol by asserting the D/C pin */
-void writeword(uint16_t c)
+/* Write a start and end address to the LCD as one data burst by asserting the D/C pin */
+void writerange(uint16_t c0, uint16_t c1)
 
 {
 
- uint8_t d;
+ uint8_t d[4];
+
+ d[0] = c0 >> 8;
 
- d = c >> 8;
+ d[1] = c0 & 0xFF;
 
- writedata(d);
+ d[2] = c1 >> 8;
 
- d = c & 0xFF;
+ d[3] = c1 & 0xFF;
 
- writedata(d);
+ LPC_GPIO0->FIOSET |= (0x1<<3);
+
+ spiwrite(d, 4);
 
 }
 
 
-/* Initialize the color panels in LCD using SSP Protocol */
+/* Stream the same color to the LCD panel <repeat> times, SSEL and D/C are set once per burst */
 void write888(uint32_t color, uint32_t repeat)
 
 {
 
- uint8_t red, green, blue;
+ uint8_t pixel[3];
 
- int i;
+ int pnum = 0;
 
- red = (color >> 16);
+ pixel[0] = (color >> 16);
 
- green = (color >> 8) & 0xFF;
+ pixel[1] = (color >> 8) & 0xFF;
 
- blue = color & 0xFF;
+ pixel[2] = color & 0xFF;
 
- for (i = 0; i< repeat; i++) {
+ LPC_GPIO0->FIOSET |= (0x1<<3);
 
-  writedata(red);
+ SSP_SSELToggle( pnum, 0 );
 
-  writedata(green);
+ SSPStreamRepeat( pnum, pixel, 3, repeat );
 
-  writedata(blue);
+ SSPStreamFlush( pnum );
 
- }
+ SSP_SSELToggle( pnum, 1 );
 
 }
 
 
-/* Initialize the Row and Column addresses of the LCD device using SSP protocol */
+/* Address window last programmed with CASET/RASET */
+typedef struct Window
+{
+	uint16_t x0;
+	uint16_t y0;
+	uint16_t x1;
+	uint16_t y1;
+	uint8_t valid;
+}Window;
+
+Window lcd_win;
+
+/* Initialize the Row and Column addresses of the LCD device using SSP protocol,
+   leaving out CASET or RASET when the panel already has that column or row range */
 void setAddrWindow(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1)
 
 {
 
- writecommand(ST7735_CASET);
+ if (!lcd_win.valid || x0 != lcd_win.x0 || x1 != lcd_win.x1)
+
+ {
+
+  writecommand(ST7735_CASET);
+
+  writerange(x0, x1);
+
+ }
+
+ if (!lcd_win.valid || y0 != lcd_win.y0 || y1 != lcd_win.y1)
 
- writeword(x0);
+ {
+
+  writecommand(ST7735_RASET);
+
+  writerange(y0, y1);
 
- writeword(x1);
+ }
 
- writecommand(ST7735_RASET);
+ lcd_win.x0 = x0; lcd_win.x1 = x1;
 
- writeword(y0);
+ lcd_win.y0 = y0; lcd_win.y1 = y1;
 
- writeword(y1);
+ lcd_win.valid = 1;
 
 }
 
@@ -212,6 +253,112 @@ void fillrect(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint32_t color)
 }
 
 
+/* SysTick ticks since frame_init(), and the frame slots */
+static volatile uint32_t sys_ticks = 0;
+
+static uint32_t frame_period, frame_due, frame_mark;
+
+static uint32_t frame_count, frame_skipped, frame_busy;
+
+void SysTick_Handler(void)
+
+{
+
+ sys_ticks++;
+
+}
+
+/* Microseconds since frame_init(), wraps after about 71 minutes */
+uint32_t frame_us()
+
+{
+
+ uint32_t t, v;
+
+ /* a tick between the two reads would pair a new count with an old value */
+ do
+
+ {
+
+  t = sys_ticks;
+
+  v = SysTick->VAL;
+
+ } while (t != sys_ticks);
+
+ return t * (1000000 / FRAME_TICK_HZ) + (SysTick->LOAD - v) / (SystemCoreClock / 1000000);
+
+}
+
+/* Start the SysTick clock and the first frame slot */
+void frame_init(uint32_t rate)
+
+{
+
+ SystemCoreClockUpdate();
+
+ SysTick_Config(SystemCoreClock / FRAME_TICK_HZ);
+
+ frame_period = 1000000 / rate;
+
+ frame_due = frame_mark = frame_us();
+
+ frame_count = frame_skipped = frame_busy = 0;
+
+}
+
+/* End the frame: sleep until the next slot, or when the frame ran over,
+   drop the slots it overran into. Returns the number of slots that passed. */
+uint32_t frame_wait()
+
+{
+
+ uint32_t now = frame_us(), slots = 1;
+
+ frame_count++;
+
+ frame_busy += now - frame_mark;
+
+ frame_due += frame_period;
+
+ if ((int32_t)(now - frame_due) >= 0)
+
+ {
+
+  slots += (now - frame_due) / frame_period + 1;
+
+  frame_skipped += slots - 1;
+
+  frame_due += (slots - 1) * frame_period;
+
+ }
+
+ while ((int32_t)(frame_us() - frame_due) < 0)
+
+  __WFI();
+
+ frame_mark = frame_us();
+
+ return slots;
+
+}
+
+/* Print how the frames since frame_init() went */
+void frame_report()
+
+{
+
+#if FRAME_STATS
+ uint32_t slots = frame_count + frame_skipped;
+
+ if (frame_count)
+
+  printf("\n%u frames in %u slots at %u fps, %u us average draw time",
+		 (unsigned)frame_count, (unsigned)slots, (unsigned)(1000000 / frame_period), (unsigned)(frame_busy / frame_count));
+#endif
+
+}
+
 /* Insert LCD Delay */
 void lcddelay(int ms)
 
@@ -268,6 +415,19 @@ void lcd_init()
 
 }
 
+/* Write a Pixel that is known to be on the panel */
+void putPixel(int16_t x, int16_t y, uint32_t color)
+
+{
+
+ setAddrWindow(x, y, x, y);
+
+ writecommand(ST7735_RAMWR);
+
+ write888(color, 1);
+
+}
+
 /* Draw a Pixel */
 void drawPixel(int16_t x, int16_t y, uint32_t color)
 
@@ -277,11 +437,94 @@ void drawPixel(int16_t x, int16_t y, uint32_t color)
 
  return;
 
- setAddrWindow(x, y, x + 1, y + 1);
+ putPixel(x, y, color);
 
- writecommand(ST7735_RAMWR);
+}
 
- write888(color, 1);
+/* Cohen-Sutherland region code of a point against the panel */
+#define CLIP_LEFT 1
+#define CLIP_RIGHT 2
+#define CLIP_BOTTOM 4
+#define CLIP_TOP 8
+
+uint8_t clipCode(int16_t x, int16_t y)
+
+{
+
+ uint8_t code = 0;
+
+ if (x < 0) code |= CLIP_LEFT;
+ else if (x >= _width) code |= CLIP_RIGHT;
+ if (y < 0) code |= CLIP_TOP;
+ else if (y >= _height) code |= CLIP_BOTTOM;
+
+ return code;
+
+}
+
+/* Range of Bresenham steps [*first, *last] of a line that stay inside
+   [majmin, majmax] on the major axis and [minmin, minmax] on the minor one.
+   After i steps the minor coordinate has moved n(i) = (i*dy + dx-1-e0)/dx
+   times, so both limits turn into bounds on i and clipping keeps exactly
+   the pixels the full loop would have drawn. Returns 0 if none are left. */
+int lineClip(int32_t x0, int32_t y0, int32_t dx, int32_t dy, int32_t ystep, int32_t e0,
+		int32_t majmin, int32_t majmax, int32_t minmin, int32_t minmax, int32_t *first, int32_t *last)
+
+{
+
+ int32_t a, b, lo, hi, c = dx - 1 - e0;
+
+ lo = (majmin > x0) ? majmin - x0 : 0;
+
+ hi = (majmax < x0 + dx) ? majmax - x0 : dx;
+
+ /* bounds on n(i) from the minor axis */
+ if (ystep > 0) {
+
+  a = minmin - y0;
+
+  b = minmax - y0;
+
+ }
+
+ else {
+
+  a = y0 - minmax;
+
+  b = y0 - minmin;
+
+ }
+
+ if (b < 0)
+
+  return 0;
+
+ if (dy == 0) {
+
+  if (a > 0)
+
+   return 0;
+
+ }
+
+ else {
+
+  /* first i with n(i) >= a, last i with n(i) <= b */
+  if (a > 0 && (a*dx - c + dy - 1)/dy > lo)
+
+   lo = (a*dx - c + dy - 1)/dy;
+
+  if (((b + 1)*dx - c - 1)/dy < hi)
+
+   hi = ((b + 1)*dx - c - 1)/dy;
+
+ }
+
+ *first = lo;
+
+ *last = hi;
+
+ return lo <= hi;
 
 }
 
@@ -300,11 +543,21 @@ void drawPixel(int16_t x, int16_t y, uint32_t color)
 
 *****************************************************************************/
 
-/* Draw a line */
+/* Draw a line. It is clipped to the panel before the Bresenham loop, so the
+   loop only visits pixels that are drawn and skips the bounds check. */
 void drawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint32_t color)
 
 {
 
+ uint8_t code0 = clipCode(x0, y0), code1 = clipCode(x1, y1);
+
+ int32_t first, last, n;
+
+ /* Both ends beyond the same edge, nothing to draw */
+ if (code0 & code1)
+
+  return;
+
  int16_t slope = abs(y1 - y0) > abs(x1 - x0);
 
  if (slope) {
@@ -345,22 +598,64 @@ void drawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint32_t color)
 
  }
 
- for (; x0 <= x1; x0++) {
+ /* A line that leaves the panel starts and ends at its first and last
+    visible step, with err and y0 moved to where the loop would have them */
+ if (code0 | code1) {
 
   if (slope) {
 
-   drawPixel(y0, x0, color);
+   if (!lineClip(x0, y0, dx, dy, ystep, err, 0, _height - 1, 0, _width - 1, &first, &last))
+
+    return;
 
   }
 
   else {
 
-   drawPixel(x0, y0, color);
+   if (!lineClip(x0, y0, dx, dy, ystep, err, 0, _width - 1, 0, _height - 1, &first, &last))
+
+    return;
 
   }
 
+  n = dy ? (first*dy + dx - 1 - err)/dx : 0;
+
+  err = err - first*dy + n*dx;
+
+  y0 += ystep*n;
+
+  x1 = x0 + last;
+
+  x0 += first;
+
+ }
+
+ int16_t run = x0;
+
+ /* Steps that share a row (or a column for steep lines) go out as one run,
+    with one address window and one RAMWR burst instead of one per pixel */
+ for (; x0 <= x1; x0++) {
+
   err -= dy;
 
+  if (err < 0 || x0 == x1) {
+
+   if (slope) {
+
+    fillrect(y0, run, y0, x0, color);
+
+   }
+
+   else {
+
+    fillrect(run, y0, x0, y0, color);
+
+   }
+
+   run = x0 + 1;
+
+  }
+
   if (err < 0) {
 
    y0 += ystep;
@@ -398,13 +693,29 @@ void designSquare(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t x2, in
 	designSquare(new_x0, new_y0, new_x1, new_y1, new_x2, new_y2, new_x3, new_y3, color, level - 1, lambda_value);
 }
 
+/* Sine and cosine of <a> from the fixmath.h table, as floats */
+void angleSinCos(fixangle a, float *s, float *c)
+
+{
+
+ fix16 fs, fc;
+
+ fix_sincos(a, &fs, &fc);
+
+ *s = fix_to_float(fs);
+
+ *c = fix_to_float(fc);
+
+}
+
 /* Rotate point p with respect to o and angle <angle> */
-Point rotate_point(Point p, Point o, float angle)
+Point rotate_point(Point p, Point o, fixangle angle)
 {
 	Point rt, t, new;
 
-	float s = sin(angle);
-	float c = cos(angle);
+	float s, c;
+
+	angleSinCos(angle, &s, &c);
 
 	//translate point to origin
 	t.x = p.x - o.x;
@@ -420,33 +731,86 @@ Point rotate_point(Point p, Point o, float angle)
 	return new;
 }
 
+/* Deepest tree designTree will generate */
+#define TREE_MAX_LEVEL 8
+
 /* Design a Tree using drawline method and rotatepoint method */
+/* Each node draws its center branch and two branches rotated by a random
+   angle, with a subtree on each of them. The nodes being worked on sit on
+   an explicit stack with the branch they are up to, which visits them (and
+   calls rand()) in the same order as recursion would, with at most <level>
+   frames instead of one C stack frame per call. */
 void designTree(Point start, Point end, int level ,float lambda_value)
 {
-	Point c, rtl, rtr;
-	if(level == 0)
-		return;
+	struct
+	{
+		Point start, end, c;
+		int level, branch;
+	}stack[TREE_MAX_LEVEL], *f;
+
+	Point tip;
+	uint32_t tipcolor;
+	int sp;
+
 	int color[] = {GREEN1, GREEN2, GREEN3, GREEN4, GREEN5, GREEN6};
 
 	int angles = 5;
 
 	// alpha degrees =5,10,15,20,30
-	float alpha[] = {pi/36, pi/18, pi/12, pi/9, pi/6};
-
-	c.x = end.x + lambda_value * (end.x - start.x);
-	c.y = end.y + lambda_value * (end.y - start.y);
+	fixangle alpha[] = {FIX_ANGLE_DEG(5), FIX_ANGLE_DEG(10), FIX_ANGLE_DEG(15), FIX_ANGLE_DEG(20), FIX_ANGLE_DEG(30)};
 
+	if(level > TREE_MAX_LEVEL)
+		level = TREE_MAX_LEVEL;
 
-	drawLine(c.x, c.y, end.x, end.y, BLACK);
-	designTree(end, c, level - 1, lambda_value);
-
-	rtl = rotate_point(c, end, alpha[rand()%angles]);
-	drawLine(rtl.x, rtl.y, end.x, end.y, color[rand()%5]);
-	designTree(end, rtl, level - 1, lambda_value);
+	if(level <= 0)
+		return;
 
-	rtr = rotate_point(c, end, -alpha[rand()%angles]);
-	drawLine(rtr.x, rtr.y, end.x, end.y, color[rand()%5]);
-	designTree(end, rtr, level - 1, lambda_value);
+	stack[0].start = start;
+	stack[0].end = end;
+	stack[0].level = level;
+	stack[0].branch = 0;
+	sp = 1;
+
+	while(sp > 0)
+	{
+		f = &stack[sp - 1];
+
+		switch(f->branch++)
+		{
+		case 0:
+			f->c.x = f->end.x + lambda_value * (f->end.x - f->start.x);
+			f->c.y = f->end.y + lambda_value * (f->end.y - f->start.y);
+			tip = f->c;
+			tipcolor = BLACK;
+			break;
+
+		case 1:
+			tip = rotate_point(f->c, f->end, alpha[rand()%angles]);
+			tipcolor = color[rand()%5];
+			break;
+
+		case 2:
+			tip = rotate_point(f->c, f->end, -alpha[rand()%angles]);
+			tipcolor = color[rand()%5];
+			break;
+
+		default:
+			sp--;
+			continue;
+		}
+
+		drawLine(tip.x, tip.y, f->end.x, f->end.y, tipcolor);
+
+		// the subtree on the new branch
+		if(f->level > 1)
+		{
+			stack[sp].start = f->end;
+			stack[sp].end = tip;
+			stack[sp].level = f->level - 1;
+			stack[sp].branch = 0;
+			sp++;
+		}
+	}
 }
 
 /* Design the branch of a tree */
@@ -476,7 +840,7 @@ void designSquareLoop(int color[], float lambda_value)
 			 y3 = y0;
 
 			 designSquare(x0, y0, x1, y1, x2, y2, x3, y3, color[cindex], 10, lambda_value);
-			 lcddelay(5);
+			 frame_wait();
 
 		 }
 
@@ -501,6 +865,7 @@ void designTreeLoop(Point start, Point end, float lambda_value)
 		 end.y = start.y;
 		 designTreebranch(start, end, BLACK, 2);
 		 designTree(start, end, 7, lambda_value);
+		 frame_wait();
 	 }
 }
 
@@ -515,7 +880,10 @@ int main (void)
 
 	srand(time(NULL));
 	if ( pnum == 0 )
+	{
 		SSP0Init();
+		SSPSetClock(pnum, LCD_SPI_HZ);
+	}
 	else
 		 puts("Port number is not correct");
 
@@ -566,7 +934,9 @@ int main (void)
 					break;
 				}
 	 	    	fillrect(0, 0, ST7735_TFTWIDTH, ST7735_TFTHEIGHT, BLACK);
+	 	    	frame_init(FRAME_RATE);
 	 	    	designSquareLoop(color, lambda_value);
+	 	    	frame_report();
 	 	       break;
 
 	 	    case 2 :
@@ -578,7 +948,9 @@ int main (void)
 	 	    		fillrect(i, 0, i+1, ST7735_TFTHEIGHT, 1638655-2*(i-40));
 	 	    	 }
 				 fillrect(0, 0, 40, ST7735_TFTHEIGHT, 0x4A290A);
+				 frame_init(FRAME_RATE);
 				 designTreeLoop(start, end, lambda_value);
+				 frame_report();
 	 	       break;
 
 	 	   case 3  :
@@ -29,6 +29,9 @@ volatile uint32_t interrupt1RxStat = 0;
 volatile uint32_t interrupt1OverRunStat = 0;
 volatile uint32_t interrupt1RxTimeoutStat = 0;
 
+/* frames pushed by the streaming API whose RX echo is not drained yet */
+static uint32_t streamInFlight[2];
+
 /*****************************************************************************
 ** Function name:		SSP_IRQHandler
 **
@@ -169,11 +172,10 @@ void SSP0Init( void )
   LPC_GPIO0->FIODIR |= (0x1<<16);		/* P0.16 defined as GPIO and Outputs */
 #endif
 		
-  /* Set DSS data to 8-bit, Frame format SPI, CPOL = 0, CPHA = 0, and SCR is 15 */
-  LPC_SSP0->CR0 = 0x0707;
-
-  /* SSPCPSR clock prescale register, master mode, minimum divisor is 0x02 */
-  LPC_SSP0->CPSR = 0x2;
+  /* Set DSS data to 8-bit, Frame format SPI, CPOL = 0, CPHA = 0. CPSR and
+  SCR are picked by SSPSetClock for the startup bit rate. */
+  LPC_SSP0->CR0 = 0x0007;
+  SSPSetClock( 0, SSP_SAFE_HZ );
 
   for ( i = 0; i < FIFOSIZE; i++ )
   {
@@ -234,11 +236,10 @@ void SSP1Init( void )
   LPC_GPIO0->FIODIR |= (0x1<<6);		/* P0.6 defined as GPIO and Outputs */
 //#endif
 		
-  /* Set DSS data to 8-bit, Frame format SPI, CPOL = 0, CPHA = 0, and SCR is 15 */
-  LPC_SSP1->CR0 = 0x0707;
-
-  /* SSPCPSR clock prescale register, master mode, minimum divisor is 0x02 */
-  LPC_SSP1->CPSR = 0x2;
+  /* Set DSS data to 8-bit, Frame format SPI, CPOL = 0, CPHA = 0. CPSR and
+  SCR are picked by SSPSetClock for the startup bit rate. */
+  LPC_SSP1->CR0 = 0x0007;
+  SSPSetClock( 1, SSP_SAFE_HZ );
 
   for ( i = 0; i < FIFOSIZE; i++ )
   {
@@ -272,6 +273,106 @@ void SSP1Init( void )
   return;
 }
 
+/*****************************************************************************
+** Function name:		SSPGetPclk
+**
+** Descriptions:		Peripheral clock of the SSP port, from CCLK and the
+**						PCLKSEL divider it was given at startup.
+**
+** parameters:			port num
+** Returned value:		peripheral clock in Hz
+** 
+*****************************************************************************/
+static uint32_t SSPGetPclk( uint32_t portnum )
+{
+  uint32_t sel;
+
+  SystemCoreClockUpdate();
+  if ( portnum == 0 )
+	sel = (LPC_SC->PCLKSEL1 >> 10) & 0x3;
+  else
+	sel = (LPC_SC->PCLKSEL0 >> 20) & 0x3;
+
+  switch ( sel )
+  {
+	case 0:  return SystemCoreClock / 4;
+	case 1:  return SystemCoreClock;
+	case 2:  return SystemCoreClock / 2;
+	default: return SystemCoreClock / 8;
+  }
+}
+
+/*****************************************************************************
+** Function name:		SSPSetClock
+**
+** Descriptions:		Select the fastest SSP bit rate that does not exceed
+**						the requested one. The CPSR/SCR pair with the
+**						smallest overall divider is programmed against the
+**						current peripheral clock. PCLKSEL is left alone:
+**						changing it with PLL0 connected is unreliable
+**						(errata PCLKSELx.1), and CCLK/4 already reaches
+**						the panel's rates. The bit rate is
+**						PCLK / (CPSDVSR * (SCR + 1)).
+**
+** parameters:			port num, target bit rate in Hz
+** Returned value:		bit rate actually programmed in Hz
+** 
+*****************************************************************************/
+uint32_t SSPSetClock( uint32_t portnum, uint32_t bitrate )
+{
+  LPC_SSP_TypeDef *ssp = (portnum == 0) ? LPC_SSP0 : LPC_SSP1;
+  uint32_t pclk, cpsr, scr, div, best_cpsr, best_scr, best_div;
+
+  pclk = SSPGetPclk( portnum );
+  if ( bitrate == 0 )
+	bitrate = 1;
+
+  best_cpsr = SSP_CPSR_MAX;
+  best_scr = SSP_SCR_MAX;
+  best_div = SSP_CPSR_MAX * (SSP_SCR_MAX + 1);
+  for ( cpsr = SSP_CPSR_MIN; cpsr <= SSP_CPSR_MAX; cpsr += 2 )
+  {
+	/* smallest SCR that keeps the bit rate at or below the target */
+	scr = (pclk + cpsr * bitrate - 1) / (cpsr * bitrate);
+	if ( scr > 0 )
+	  scr--;
+	if ( scr > SSP_SCR_MAX )
+	  continue;
+	div = cpsr * (scr + 1);
+	if ( div < best_div )
+	{
+	  best_div = div;
+	  best_cpsr = cpsr;
+	  best_scr = scr;
+	}
+  }
+
+  /* Only change the clock between frames */
+  while ( ssp->SR & SSPSR_BSY );
+
+  ssp->CPSR = best_cpsr;
+  ssp->CR0 = (ssp->CR0 & 0xFF) | (best_scr << 8);
+
+  return pclk / best_div;
+}
+
+/*****************************************************************************
+** Function name:		SSPGetClock
+**
+** Descriptions:		Compute the bit rate the SSP port runs at from
+**						CCLK, its PCLKSEL divider, CPSR and SCR.
+**
+** parameters:			port num
+** Returned value:		bit rate in Hz
+** 
+*****************************************************************************/
+uint32_t SSPGetClock( uint32_t portnum )
+{
+  LPC_SSP_TypeDef *ssp = (portnum == 0) ? LPC_SSP0 : LPC_SSP1;
+
+  return SSPGetPclk( portnum ) / (ssp->CPSR * (((ssp->CR0 >> 8) & 0xFF) + 1));
+}
+
 /*****************************************************************************
 ** Function name:		SSPSend
 **
@@ -328,6 +429,117 @@ void SSPSend( uint32_t portnum, uint8_t *buf, uint32_t Length )
   return; 
 }
 
+/*****************************************************************************
+** Function name:		SSPStreamSend
+**
+** Descriptions:		Stream a block of data to the SSP port. Unlike
+**						SSPSend(), it does not wait for every frame to
+**						finish: the TX FIFO is kept topped up and the RX
+**						FIFO is only drained when it holds data. At most
+**						FIFOSIZE frames are in flight, so RX never overruns.
+**						The caller owns SSEL and must call SSPStreamFlush()
+**						before releasing it or changing the LCD D/C line.
+**
+** parameters:			port num, buffer pointer, and the block length
+** Returned value:		None
+** 
+*****************************************************************************/
+void SSPStreamSend( uint32_t portnum, const uint8_t *buf, uint32_t Length )
+{
+  LPC_SSP_TypeDef *ssp = (portnum == 0) ? LPC_SSP0 : LPC_SSP1;
+  uint32_t inflight = streamInFlight[portnum];
+  uint8_t Dummy = Dummy;
+
+  while ( Length )
+  {
+	if ( ssp->SR & SSPSR_RNE )
+	{
+	  Dummy = ssp->DR;
+	  inflight--;
+	}
+	if ( inflight < FIFOSIZE )
+	{
+	  ssp->DR = *buf++;
+	  inflight++;
+	  Length--;
+	}
+  }
+  streamInFlight[portnum] = inflight;
+  return;
+}
+
+/*****************************************************************************
+** Function name:		SSPStreamRepeat
+**
+** Descriptions:		Stream a short pattern (e.g. one RGB pixel) Count
+**						times without reloading it from the caller, same
+**						FIFO handling as SSPStreamSend().
+**
+** parameters:			port num, pattern pointer, pattern length, repeat count
+** Returned value:		None
+** 
+*****************************************************************************/
+void SSPStreamRepeat( uint32_t portnum, const uint8_t *pattern, uint32_t PatLength, uint32_t Count )
+{
+  LPC_SSP_TypeDef *ssp = (portnum == 0) ? LPC_SSP0 : LPC_SSP1;
+  uint32_t inflight = streamInFlight[portnum];
+  uint32_t i = 0;
+  uint8_t Dummy = Dummy;
+
+  if ( PatLength == 0 )
+	return;
+
+  while ( Count )
+  {
+	if ( ssp->SR & SSPSR_RNE )
+	{
+	  Dummy = ssp->DR;
+	  inflight--;
+	}
+	if ( inflight < FIFOSIZE )
+	{
+	  ssp->DR = pattern[i];
+	  inflight++;
+	  if ( ++i == PatLength )
+	  {
+		i = 0;
+		Count--;
+	  }
+	}
+  }
+  streamInFlight[portnum] = inflight;
+  return;
+}
+
+/*****************************************************************************
+** Function name:		SSPStreamFlush
+**
+** Descriptions:		Wait until every streamed frame has left the shift
+**						register and drain the matching RX bytes.
+**
+** parameters:			port num
+** Returned value:		None
+** 
+*****************************************************************************/
+void SSPStreamFlush( uint32_t portnum )
+{
+  LPC_SSP_TypeDef *ssp = (portnum == 0) ? LPC_SSP0 : LPC_SSP1;
+  uint32_t inflight = streamInFlight[portnum];
+  uint8_t Dummy = Dummy;
+
+  while ( inflight )
+  {
+	if ( ssp->SR & SSPSR_RNE )
+	{
+	  Dummy = ssp->DR;
+	  inflight--;
+	}
+  }
+  while ( ssp->SR & SSPSR_BSY );
+  streamInFlight[portnum] = 0;
+  return;
+}
+
 /*****************************************************************************
 ** Function name:		SSPSendReceive
 ** Descriptions:		the module will receive a block of data from
@@ -46,6 +46,15 @@
 #define DELAY_COUNT		10
 #define MAX_TIMEOUT		0xFF
 
+/* SSP clock prescaler limits, CPSDVSR must be even */
+#define SSP_CPSR_MIN	2
+#define SSP_CPSR_MAX	254
+#define SSP_SCR_MAX		255
+
+/* Bit rate SSPxInit starts the ports at, slow enough for any device on the
+bus. Raise it with SSPSetClock once the device is set up. */
+#define SSP_SAFE_HZ		1000000
+
 /* Port0.2 is the SSP select pin */
 #define SSP0_SEL		(1 << 2)
 	
@@ -113,6 +122,11 @@ extern void SSP1Init( void );
 extern void SSP2Init( void );
 extern void SSPSend( uint32_t portnum, uint8_t *Buf, uint32_t Length );
 extern void SSPReceive( uint32_t portnum, uint8_t *buf, uint32_t Length );
+extern uint32_t SSPSetClock( uint32_t portnum, uint32_t bitrate );
+extern uint32_t SSPGetClock( uint32_t portnum );
+extern void SSPStreamSend( uint32_t portnum, const uint8_t *buf, uint32_t Length );
+extern void SSPStreamRepeat( uint32_t portnum, const uint8_t *pattern, uint32_t PatLength, uint32_t Count );
+extern void SSPStreamFlush( uint32_t portnum );
 uint8_t SSP1SendReceive(uint8_t out);	//only for SSP1
 #endif  /* __SSP_H__ */
 /*****************************************************************************
@@ -46,13 +46,16 @@
 ===============================================================================
 */
 
+#include <cr_section_macros.h>
 #include <LPC17xx.h>                        /* LPC17xx definitions */
 #include <math.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "ssp.h"
+#include "fixmath.h"
 
 /* Be careful with the port number and location number, because
 
@@ -71,46 +74,203 @@ uint8_t dest_addr[SSP_BUFSIZE];
 #define ST7735_RAMWR 0x2C
 #define ST7735_SLPOUT 0x11
 #define ST7735_DISPON 0x29
+#define ST7735_COLMOD 0x3A
+#define ST7735_RDDID 0x04
+#define ST7735_TEON 0x35
+
+// SPI bit rate for the LCD link. The ST7735 write cycle is at least 66 ns,
+// so 15 MHz is the fastest the panel is specified for.
+#define LCD_SPI_HZ 15000000
+
+// Calibration mode: start at LCD_SPI_SAFE_HZ, the rate SSP0Init leaves the
+// port at, and step the clock up while the display ID (RDDID) still reads
+// back correctly. Needs the panel's SDA/MISO wired to MISO0, falls back to
+// LCD_SPI_HZ when nothing can be read back. The search stops at
+// LCD_SPI_TUNE_MAX_HZ or at the fastest rate SSP0 reaches from its PCLK
+// (PCLK/2), whichever is lower.
+#define LCD_SPI_AUTOTUNE 0
+#define LCD_SPI_SAFE_HZ SSP_SAFE_HZ
+#define LCD_SPI_TUNE_STEP 1000000
+#define LCD_SPI_TUNE_MAX_HZ 40000000
+#define LCD_SPI_TUNE_READS 4
+
+// Tearing effect: TEON makes the panel raise its TE output at the start of
+// every vertical blank. With LCD_USE_TE a GPIO interrupt on P0.LCD_TE_PIN
+// times the refresh and each RAMWR burst waits until the scan is clear of the
+// rows it writes, so no region is ever shown half written. A refresh is
+// LCD_TE_LINES lines and row 0 is scanned LCD_TE_ROW0 lines after the edge
+// (160 rows plus the FRMCTR1 default porches of 44 and 45 lines, plus 2).
+// Direct fills go out in bands of LCD_TE_BAND rows that fit between two
+// passes of the scan. Without TE on the pin nothing is held back.
+#define LCD_USE_TE 1
+#define LCD_TE_PIN 23
+#define LCD_TE_LINES 251
+#define LCD_TE_ROW0 91
+#define LCD_TE_BAND 16
+
+// Pixel format on the wire: 1 selects RGB565 (COLMOD 0x05, 2 bytes per pixel),
+// 0 keeps the 18-bit mode (COLMOD 0x06, 3 bytes per pixel). Colors are packed
+// for the selected format at compile time with LCD_COLOR(), so everything past
+// the color defines already holds panel-ready values.
+#define LCD_COLOR_565 1
+
+// Pixel data is held in lcdword units, one per SSP frame. RGB565 pixels go
+// out as a single 16-bit frame and are stored as native halfwords, 18-bit
+// pixels as three 8-bit frames in panel byte order. lcdcolor is the smallest
+// type that holds a packed color.
+#if LCD_COLOR_565
+#define LCD_COLOR(c) ((((c) >> 8) & 0xF800) | (((c) >> 5) & 0x07E0) | (((c) >> 3) & 0x001F))
+#define LCD_BPP 2
+#define LCD_COLMOD_VALUE 0x05
+#define LCD_FRAME_BITS 16
+#define LCD_WORDS 1
+typedef uint16_t lcdword;
+typedef uint16_t lcdcolor;
+#else
+#define LCD_COLOR(c) (c)
+#define LCD_BPP 3
+#define LCD_COLMOD_VALUE 0x06
+#define LCD_FRAME_BITS 8
+#define LCD_WORDS 3
+typedef uint8_t lcdword;
+typedef uint32_t lcdcolor;
+#endif
 
 #define swap(x, y) {x = x + y; y = x - y; x = x - y ;}
 
+// Solid fills of at least LCD_DMA_MIN_PIXELS go out by GPDMA from a pattern
+// block of LCD_DMA_PIXELS pixels, large enough to chain a full-panel fill.
+#define LCD_DMA_PIXELS 256
+#define LCD_DMA_MIN_PIXELS 32
+
+// GPDMA can only read the AHB SRAM banks
+__BSS(RAM2) static lcdword dma_pattern[LCD_WORDS*LCD_DMA_PIXELS];
+
+// Render into the tiled off-screen framebuffer and send dirty rectangles on
+// fb_flush(), instead of addressing the panel for every single pixel
+#define USE_FRAMEBUFFER 1
+
+// Record static parts of the scene into display lists and replay them on
+// later frames, DL_POOL_BYTES of local SRAM hold the background's list.
+// Runs are six bytes with their depth, the sphere and axes take 2513.
+#define USE_DISPLAY_LIST 1
+#define DL_POOL_BYTES (15*1024)
+
+// Depth test the polygon rasterizer against a 16-bit depth buffer. Depth
+// is stored per framebuffer tile and only for tiles that filled polygons
+// touch, ZB_POOL_TILES tiles of 512 bytes in local SRAM.
+#define USE_DEPTH_BUFFER 1
+#define ZB_POOL_TILES 20
+
+// The 32K of local SRAM hold the depth pool (10K), the display list (15K),
+// the framebuffer tile table and cover masks (2.6K), the tree cache (1K)
+// and the stack, of which drawSphere takes about 1.8K. Raising either pool
+// has to come out of the last 1.5K or so.
+
+// Carry world, viewer and screen coordinates in Q16.16 fixed point
+// (fixmath.h) instead of soft-float, through the transform, lighting,
+// shadow and rotation math. FIXMATH_SELFTEST checks the fixed point
+// results against float at startup and prints the largest error of each.
+#define USE_FIXED_POINT 1
+#define FIXMATH_SELFTEST 1
+
+// Redraw the scene FRAME_RATE times a second, paced by SysTick, with the cube
+// turning FRAME_TURN degrees per frame. A frame that overruns its slot skips
+// the slots it ran into, while the rotation still advances by every slot so
+// the cube turns at a steady speed. Every FRAME_STATS seconds the frame rate,
+// skipped slots and time per stage are printed (0 to stay quiet). FRAME_LIMIT
+// frames are drawn before main returns, 0 runs forever. ANIMATE 0 draws the
+// scene once.
+#define ANIMATE 1
+#define FRAME_RATE 20
+#define FRAME_TURN -2
+#define FRAME_STATS 5
+#define FRAME_LIMIT 0
+
+// Redraw frames incrementally: the screen boxes the cube and its shadow
+// covered are kept, and the next frame clears only those and repaints the
+// background inside them from its display list, instead of clearing the
+// whole panel. The static layers elsewhere are left alone.
+#define USE_INCREMENTAL_REDRAW 1
+
+// The panel is cut into 16x16 tiles. Tiles only hold memory while they are
+// being drawn to, the pool lives in the AHB SRAM banks so the GPDMA can
+// stream a tile straight out of it.
+#define FB_TILE_W 16
+#define FB_TILE_H 16
+#define FB_TILES_X ((ST7735_TFTWIDTH+1)/FB_TILE_W)
+#define FB_TILES_Y ((ST7735_TFTHEIGHT+1)/FB_TILE_H)
+#define FB_TILE_BYTES (FB_TILE_W*FB_TILE_H*LCD_BPP)
+#define FB_TILE_WORDS (FB_TILE_W*FB_TILE_H*LCD_WORDS)
+#define FB_POOL_BYTES (26*1024)
+#define FB_POOL_TILES (FB_POOL_BYTES/FB_TILE_BYTES)
+
+// Tile states
+#define FB_TILE_UNKNOWN 0		// panel content is not tracked
+#define FB_TILE_SOLID 1			// whole tile is one color, on the panel once clean
+#define FB_TILE_BUFFERED 2		// tile owns a pool slot
+
 // defining color values
 
-#define LIGHTBLUE 0x00FFE0
-#define GREEN 0x00FF00
-#define DARKBLUE 0x000033
-#define BLACK 0x000000
-#define BLUE 0x0007FF
-#define RED 0xFF0000
-#define MAGENTA 0x00F81F
-#define WHITE 0xFFFFFF
-#define PURPLE 0xCC33FF
+#define LIGHTBLUE LCD_COLOR(0x00FFE0)
+#define GREEN LCD_COLOR(0x00FF00)
+#define DARKBLUE LCD_COLOR(0x000033)
+#define BLACK LCD_COLOR(0x000000)
+#define BLUE LCD_COLOR(0x0007FF)
+#define RED LCD_COLOR(0xFF0000)
+#define MAGENTA LCD_COLOR(0x00F81F)
+#define WHITE LCD_COLOR(0xFFFFFF)
+#define PURPLE LCD_COLOR(0xCC33FF)
 
 // Self Defined Colors
-#define BROWN 0xA52A2A
-#define YELLOW 0xFFFE00
-#define GREY1 0x7A7C7B
-#define BLUE1 0x3999FF
+#define BROWN LCD_COLOR(0xA52A2A)
+#define YELLOW LCD_COLOR(0xFFFE00)
+#define GREY1 LCD_COLOR(0x7A7C7B)
+#define BLUE1 LCD_COLOR(0x3999FF)
 
 // Self Defined GREEN Shades
-#define GREEN1 0x38761D
-#define GREEN2 0x002200
-#define GREEN3 0x00FC7C
-#define GREEN4 0x32CD32
-#define GREEN5 0x228B22
-#define GREEN6 0x006400
+#define GREEN1 LCD_COLOR(0x38761D)
+#define GREEN2 LCD_COLOR(0x002200)
+#define GREEN3 LCD_COLOR(0x00FC7C)
+#define GREEN4 LCD_COLOR(0x32CD32)
+#define GREEN5 LCD_COLOR(0x228B22)
+#define GREEN6 LCD_COLOR(0x006400)
 
 // Self Defined RED Shades
-#define RED1 0xE61C1C
-#define RED2 0xEE3B3B
-#define RED3 0xEF4D4D
-#define RED4 0xE88080
-
-#define pi 3.1416
+#define RED1 LCD_COLOR(0xE61C1C)
+#define RED2 LCD_COLOR(0xEE3B3B)
+#define RED3 LCD_COLOR(0xEF4D4D)
+#define RED4 LCD_COLOR(0xE88080)
 
 int _height = ST7735_TFTHEIGHT;
 int _width = ST7735_TFTWIDTH;
 
+// Scalar of world, viewer and screen coordinates. The fixed point build keeps
+// points in Q16.16 from the scene setup to the rasterizer and the float build
+// in float. coord_pixel takes a screen coordinate to the pixel the drawing
+// primitives take, COORD converts a constant.
+#if USE_FIXED_POINT
+typedef fix16 coord;
+typedef int64_t coordwide;				// product of two coords
+#define COORD(f) FIX_FROM_FLOAT(f)
+#define coord_from_int(i) FIX_FROM_INT(i)
+#define coord_from_float(f) fix_from_float(f)
+#define coord_to_float(a) fix_to_float(a)
+#define coord_pixel(a) ((int16_t)fix_trunc(a))
+#define coord_mul(a, b) fix_mul(a, b)
+#define coord_wide_mul(a, b) ((int64_t)(a) * (b))
+#else
+typedef float coord;
+typedef float coordwide;
+#define COORD(f) ((float)(f))
+#define coord_from_int(i) ((float)(i))
+#define coord_from_float(f) (f)
+#define coord_to_float(a) (a)
+#define coord_pixel(a) ((int16_t)(a))
+#define coord_mul(a, b) ((a) * (b))
+#define coord_wide_mul(a, b) ((a) * (b))
+#endif
+
 // Defining the eye co-ordinates
 //float Xe=250, Ye=100, Ze=60;
 //float Xe=100, Ye=250, Ze=60; //for a better tree view
@@ -120,1056 +280,3751 @@ float Xe=150, Ye=150, Ze=100;
 float D_focal=120;
 
 // Defining the point light source coordinates
-float Psx=-20, Psy=-20, Psz=220;
+coord Psx=COORD(-20), Psy=COORD(-20), Psz=COORD(220);
 
-void spiwrite(uint8_t c)
+// Address window last programmed with CASET/RASET and the position where the
+// next pixel of an open RAMWR lands. <writing> is cleared by any command other
+// than RAMWR, because that ends the memory write on the panel.
+typedef struct
 {
+	uint16_t x0; uint16_t y0; uint16_t x1; uint16_t y1;
+	uint16_t px; uint16_t py;
+	uint8_t valid; uint8_t writing;
+}lcdwindow;
 
-	 int pnum = 0;
+lcdwindow lcd_win;
 
-	 src_addr[0] = c;
+// Panel traffic is queued on SSP0 and sent by its interrupt, so drawing code
+// does not wait for every byte. A mark in the queue switches D/C and the frame
+// size once the frames before it are out. lcd_mode is the mode the queue is
+// left in by its last mark, LCD_MODE_DATA plus the frame size in bits.
+#define LCD_MODE_DATA 0x100
 
-	 SSP_SSELToggle( pnum, 0 );
+uint32_t lcd_mode;
 
-	 SSPSend( pnum, (uint8_t *)src_addr, 1 );
+// Queue hook, runs from SSP0_IRQHandler with the wire idle
+void lcd_txmark(uint32_t mode)
 
-	 SSP_SSELToggle( pnum, 1 );
+{
 
-}
+	 SSPSetFrameSize( 0, mode & 0xFF );
 
-void writecommand(uint8_t c)
+	 if (mode & LCD_MODE_DATA)
 
-{
+	  LPC_GPIO0->FIOSET |= (0x1<<3);
 
-	 LPC_GPIO0->FIOCLR |= (0x1<<3);
+	 else
 
-	 spiwrite(c);
+	  LPC_GPIO0->FIOCLR |= (0x1<<3);
 
 }
 
-void writedata(uint8_t c)
+// Select D/C and frame size for the frames queued next
+void lcd_setmode(uint32_t mode)
 
 {
 
-	 LPC_GPIO0->FIOSET |= (0x1<<3);
+	 SSP0DMAWait();
 
-	 spiwrite(c);
+	 SSP_SSELToggle( 0, 0 );
 
-}
+	 if (mode != lcd_mode) {
 
-void writeword(uint16_t c)
+	  SSPQueueMark( 0, mode );
 
-{
+	  lcd_mode = mode;
+
+	 }
+
+}
 
-	 uint8_t d;
+// Wait until the panel has received everything queued or sent by DMA
+void lcd_sync()
 
-	 d = c >> 8;
+{
 
-	 writedata(d);
+	 SSP0DMAWait();
 
-	 d = c & 0xFF;
+	 SSPQueueFence( 0 );
 
-	 writedata(d);
+	 SSP_SSELToggle( 0, 1 );
 
 }
 
-void write888(uint32_t color, uint32_t repeat)
+// Take SSP0 over from the queue to send pixel data without it (DMA)
+void lcd_direct()
 
 {
-	 uint8_t red, green, blue;
 
-	 int i;
+	 lcd_sync();
 
-	 red = (color >> 16);
+	 SSPSetFrameSize( 0, LCD_FRAME_BITS );
 
-	 green = (color >> 8) & 0xFF;
+	 LPC_GPIO0->FIOSET |= (0x1<<3);
 
-	 blue = color & 0xFF;
+	 lcd_mode = LCD_MODE_DATA | LCD_FRAME_BITS;
 
-	 for (i = 0; i< repeat; i++) {
+	 SSP_SSELToggle( 0, 0 );
 
-	  writedata(red);
+}
 
-	  writedata(green);
+void spiwrite(uint8_t c)
+{
 
-	  writedata(blue);
-	 }
+	 SSPQueueFrame( 0, c );
 
 }
 
-void setAddrWindow(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1)
+void writecommand(uint8_t c)
 
 {
-	 writecommand(ST7735_CASET);
 
-	 writeword(x0);
+	 lcd_setmode(8);
 
-	 writeword(x1);
+	 spiwrite(c);
 
-	 writecommand(ST7735_RASET);
+	 // RAMWR restarts at the window origin, anything else ends the write
+	 lcd_win.writing = (c == ST7735_RAMWR);
 
-	 writeword(y0);
+	 lcd_win.px = lcd_win.x0;
 
-	 writeword(y1);
+	 lcd_win.py = lcd_win.y0;
 
 }
 
-void fillrect(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint32_t color)
+void writedata(uint8_t c)
 
 {
-	 int16_t width, height;
 
-	 width = x1-x0+1;
+	 lcd_setmode(LCD_MODE_DATA | 8);
 
-	 height = y1-y0+1;
+	 spiwrite(c);
 
-	 setAddrWindow(x0,y0,x1,y1);
+}
 
-	 writecommand(ST7735_RAMWR);
+// Send a 16-bit parameter as one SSP frame, MSB first like the panel expects
+void writeword(uint16_t c)
 
-	 write888(color,width*height);
+{
 
-}
+	 lcd_setmode(LCD_MODE_DATA | 16);
 
-void lcddelay(int ms)
+	 SSPQueueFrame( 0, c );
 
-{
-	 int count = 24000;
-	 int i;
-	 for ( i = count*ms; i > 0; i--);
 }
 
-void lcd_init()
+// Completion callback of a DMA burst, runs from DMA_IRQHandler
+void lcd_dma_done(void)
 
 {
-	 int i;
-	 printf("Welcome to my CMPE240 Project - 3D_Shading_and_Diffuse_Reflection\n");
-	 printf("First Name: Tirumala Saiteja Goruganthu\n");
-	 printf("Last Name: Goruganthu\n");
-	 printf("SJSU ID: 016707210\n");
-	 // Set pins P0.16, P0.3, P0.22 as output
-	 LPC_GPIO0->FIODIR |= (0x1<<16);
 
-	 LPC_GPIO0->FIODIR |= (0x1<<3);
+	 SSP_SSELToggle( 0, 1 );
 
-	 LPC_GPIO0->FIODIR |= (0x1<<22);
+}
 
-	 // Hardware Reset Sequence
-	 LPC_GPIO0->FIOSET |= (0x1<<22);
-	 lcddelay(500);
+// Move the cached write pointer past <count> pixels, wrapping inside the
+// address window the same way the panel does
+void lcd_advance(uint32_t count)
 
-	 LPC_GPIO0->FIOCLR |= (0x1<<22);
-	 lcddelay(500);
+{
+	 uint32_t w = lcd_win.x1 - lcd_win.x0 + 1;
 
-	 LPC_GPIO0->FIOSET |= (0x1<<22);
-	 lcddelay(500);
+	 uint32_t h = lcd_win.y1 - lcd_win.y0 + 1;
 
-	 // initialize buffers
-	 for ( i = 0; i < SSP_BUFSIZE; i++ )
-	 {
+	 uint32_t pos = (lcd_win.py - lcd_win.y0)*w + (lcd_win.px - lcd_win.x0) + count;
 
-	   src_addr[i] = 0;
-	   dest_addr[i] = 0;
-	 }
+	 pos %= w*h;
 
-	 // Take LCD display out of sleep mode
-	 writecommand(ST7735_SLPOUT);
-	 lcddelay(200);
+	 lcd_win.px = lcd_win.x0 + pos % w;
 
-	 // Turn LCD display on
-	 writecommand(ST7735_DISPON);
-	 lcddelay(200);
+	 lcd_win.py = lcd_win.y0 + pos / w;
 
 }
 
-// Converting virtual X-Coordinate to physical X-Coordinate
-int16_t xConvertToPhysical(int16_t x)
-{
-	x = x + (_width>>1);
-	return x;
-}
+// Split a packed color into the frames sent for one pixel
+void lcd_pack(uint32_t color, lcdword *pixel)
 
-// Converting virtual Y-Coordinate to physical Y-Coordinate
-int16_t yConvertToPhysical(int16_t y)
 {
-	y = (_height>>1) - y;
-	return y;
+#if LCD_COLOR_565
+	 pixel[0] = color;
+#else
+	 pixel[0] = (color >> 16);
+
+	 pixel[1] = (color >> 8) & 0xFF;
+
+	 pixel[2] = color & 0xFF;
+#endif
 }
 
-void drawPixel(int16_t x, int16_t y, uint32_t color)
+// Send the same packed color to RAMWR <repeat> times. Short runs are queued,
+// large fills are handed to the GPDMA and return at once, SSEL is released
+// by lcd_dma_done.
+void writecolor(uint32_t color, uint32_t repeat)
 
 {
-	// Convert Virtual to Physical
-	x=xConvertToPhysical(x);
-	y=yConvertToPhysical(y);
+	 lcdword pixel[LCD_WORDS];
 
-	 if ((x < 0) || (x >= _width) || (y < 0) || (y >= _height))
+	 int pnum = 0;
 
-	 return;
+	 uint32_t i, n;
 
-	 setAddrWindow(x, y, x + 1, y + 1);
+	 lcd_pack(color, pixel);
 
-	 writecommand(ST7735_RAMWR);
+	 lcd_advance(repeat);
 
-	 write888(color, 1);
+	 if (repeat >= LCD_DMA_MIN_PIXELS) {
 
-}
+	  lcd_direct();
 
-/*****************************************************************************
+	  n = (repeat < LCD_DMA_PIXELS) ? repeat : LCD_DMA_PIXELS;
 
+	  for (i = 0; i < LCD_WORDS*n; i++) {
 
-** Descriptions:        Draw line function
+	   dma_pattern[i] = pixel[i % LCD_WORDS];
 
-**
+	  }
 
-** parameters:           Starting point (x0,y0), Ending point(x1,y1) and color
+	  if (SSP0DMASendRepeat((uint8_t *)dma_pattern, LCD_BPP*n, LCD_BPP*repeat, lcd_dma_done))
 
-** Returned value:        None
+	   return;
 
-**
+	 }
 
-*****************************************************************************/
+	 lcd_setmode(LCD_MODE_DATA | LCD_FRAME_BITS);
 
+	 for (i = 0; i < repeat; i++) {
+#if LCD_COLOR_565
+	  SSPQueueFrame( pnum, pixel[0] );
+#else
+	  SSPQueueSend( pnum, pixel, LCD_BPP );
+#endif
+	 }
 
-void drawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint32_t color)
+}
 
-{
+// Program the address window, leaving out CASET or RASET when the panel
+// already has that column or row range
+void setAddrWindow(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1)
 
-	 int16_t slope = abs(y1 - y0) > abs(x1 - x0);
+{
+	 if (!lcd_win.valid || x0 != lcd_win.x0 || x1 != lcd_win.x1) {
 
-	 if (slope) {
+	  writecommand(ST7735_CASET);
 
-	  swap(x0, y0);
+	  writeword(x0);
 
-	  swap(x1, y1);
+	  writeword(x1);
 
 	 }
 
-	 if (x0 > x1) {
+	 if (!lcd_win.valid || y0 != lcd_win.y0 || y1 != lcd_win.y1) {
 
-	  swap(x0, x1);
+	  writecommand(ST7735_RASET);
 
-	  swap(y0, y1);
+	  writeword(y0);
 
-	 }
+	  writeword(y1);
 
-	 int16_t dx, dy;
+	 }
 
-	 dx = x1 - x0;
+	 lcd_win.x0 = x0; lcd_win.x1 = x1;
 
-	 dy = abs(y1 - y0);
+	 lcd_win.y0 = y0; lcd_win.y1 = y1;
 
-	 int16_t err = dx / 2;
+	 lcd_win.valid = 1;
 
-	 int16_t ystep;
+}
 
-	 if (y0 < y1) {
+// Get ready to send pixels for (x,y). If an open RAMWR already points there
+// nothing is sent and the panel's auto-increment does the addressing,
+// otherwise a window from (x,y) to the bottom-right corner is opened so
+// that following pixels can keep streaming.
+void lcd_seek(uint16_t x, uint16_t y)
 
-	  ystep = 1;
+{
+	 if (lcd_win.writing && x == lcd_win.px && y == lcd_win.py)
 
-	 }
+	  return;
 
-	 else {
+	 setAddrWindow(x, y, _width - 1, _height - 1);
 
-	  ystep = -1;
+	 writecommand(ST7735_RAMWR);
 
-	 }
+}
 
-	 for (; x0 <= x1; x0++) {
+/*****************************************************************************
 
-	  if (slope) {
+** Clock and tearing effect
 
-	   drawPixel(y0, x0, color);
+** SysTick runs at FRAME_TICK_HZ and counts ticks, which together with the
+** SysTick counter gives a microsecond clock. The TE interrupt stamps every
+** vertical blank with it, so the line the panel is scanning follows from the
+** time since the last edge. Lines count from the edge: the blanking lines
+** first, row y at LCD_TE_ROW0 + y. lcd_te_gate() holds a RAMWR burst until
+** the scan has left its rows and will not get back to them before the burst
+** is out.
 
-	  }
+*****************************************************************************/
 
-	  else {
+#define FRAME_TICK_HZ 1000
+#define LCD_TE_UNKNOWN 0xFFFF		// no scan position to go by
 
-	   drawPixel(x0, y0, color);
+typedef struct
+{
+	uint32_t last;				// us, last TE edge
+	uint32_t period;			// us per refresh, 0 until two edges were seen
+	uint32_t edges;
+	uint32_t px_ns;				// ns per pixel on the wire
+	uint32_t held;				// bursts held back
+	uint32_t wait;				// us they were held
+}lcdte;
+
+static volatile uint32_t sys_ticks = 0;
+static volatile lcdte lcd_te;
+
+void SysTick_Handler(void)
+{
+	sys_ticks++;
+}
 
-	  }
+// Microseconds since frame_init(). Wraps after about 71 minutes, the
+// scheduler only ever looks at differences.
+uint32_t frame_us()
+{
+	uint32_t t, v, wrapped;
 
-	  err -= dy;
+	// a tick between the two reads would pair a new count with an old value
+	do
+	{
+		t = sys_ticks;
+		v = SysTick->VAL;
 
-	  if (err < 0) {
+		// Called from EINT3 the handler cannot run, so a wrap only shows up
+		// as a pending SysTick. VAL has reloaded by the time the bit is seen
+		// set, so it is read again to go with the extra tick.
+		wrapped = SCB->ICSR & SCB_ICSR_PENDSTSET_Msk;
 
-	   y0 += ystep;
+		if (wrapped)
 
-	   err += dx;
+		 v = SysTick->VAL;
+	}while (t != sys_ticks);
 
-	  }
+	if (wrapped)
 
-	 }
+	 t++;
 
+	return t * (1000000 / FRAME_TICK_HZ) + (SysTick->LOAD - v) / (SystemCoreClock / 1000000);
 }
 
-// Declare a structure for 3D
-typedef struct
+// Switch TE on and listen to it. Bursts are timed from the SSP0 bit rate,
+// so this comes after the clock is set, and SysTick has to be running.
+void lcd_te_init()
 {
-	float x_value; float y_value; float z_value;
-}Pts3D;
+#if LCD_USE_TE
+	lcd_te.px_ns = (uint32_t)(LCD_BPP*8*1000000000ULL / SSPGetClock(0));
+	lcd_te.period = lcd_te.edges = 0;
+
+	LPC_GPIO0->FIODIR &= ~(1 << LCD_TE_PIN);
+	LPC_GPIOINT->IO0IntClr = 1 << LCD_TE_PIN;
+	LPC_GPIOINT->IO0IntEnR |= 1 << LCD_TE_PIN;
+	NVIC_EnableIRQ(EINT3_IRQn);
+
+	writecommand(ST7735_TEON);
+	writedata(0x00);			// V-blank only
+	lcd_sync();
+#endif
+}
 
-// Declare a structure for 2D
-typedef struct
+#if LCD_USE_TE
+// TE rising edge. An edge more than half a period late means one was missed,
+// which is not taken as the new period.
+void EINT3_IRQHandler(void)
 {
-	float x; float y;
-}Pts2D;
+	uint32_t now, d;
 
-// This method is used to calculate the Lambda value in Ray equation calculation
-float Lambda3D(float Zi,float Zs)
-{
-	float lambda;
-	lambda = -Zi/(Zs-Zi);
-	return lambda;
-}
+	if (!(LPC_GPIOINT->IO0IntStatR & (1 << LCD_TE_PIN)))
+		return;
 
-// This method is used to compute the ray equation for shadow point calculation
-Pts3D ShadowPoint3D(Pts3D Pi, Pts3D Ps, float lambda)
-{
-	Pts3D pt;
-	pt.x_value = (Pi.x_value + (lambda*(Ps.x_value-Pi.x_value)));
-	pt.y_value = (Pi.y_value + (lambda*(Ps.y_value-Pi.y_value)));
-	pt.z_value = (Pi.z_value + (lambda*(Ps.z_value-Pi.z_value)));
-	return pt;
+	LPC_GPIOINT->IO0IntClr = 1 << LCD_TE_PIN;
+
+	now = frame_us();
+	d = now - lcd_te.last;
+	if (lcd_te.edges && (lcd_te.period == 0 || d < lcd_te.period + (lcd_te.period >> 1)))
+		lcd_te.period = d;
+	lcd_te.last = now;
+	lcd_te.edges++;
 }
+#endif
 
-// This method is used to compute the diffuse reflection color with given reflectivity coefficients
-int getDiffuseColor(Pts3D Pi, float reflectivity_r, float reflectivity_g, float reflectivity_b)
+// Line the panel scans at <now>, LCD_TE_UNKNOWN before two TE edges were seen
+// or once they stop coming
+uint32_t lcd_te_line(uint32_t now)
 {
-	uint32_t print_diffuse_color;
-	Pts3D Ps;
-	Ps.x_value = Psx;
-	Ps.y_value = Psy;
-	Ps.z_value = Psz;
-	int diff_red, diff_green, diff_blue;
-	float new_red, new_green, new_blue, scaling = 16000;
-
-	//Calculate the diffuse reflection for point Pi
-	float_t temp = ((Ps.z_value - Pi.z_value)/sqrt(pow((Ps.x_value - Pi.x_value),2) + pow((Ps.y_value - Pi.y_value),2) + pow((Ps.z_value - Pi.z_value),2))) / (pow((Ps.x_value - Pi.x_value),2) + pow((Ps.y_value - Pi.y_value),2) + pow((Ps.z_value - Pi.z_value),2));
+	uint32_t period = lcd_te.period, since = now - lcd_te.last;
 
-	//Scale the above result
-	temp *= scaling;
-	diff_red = reflectivity_r * temp * 255;
-	diff_green = reflectivity_g * temp * 255;
-	diff_blue  = reflectivity_b * temp * 255;
-
-	//Shift the above values into their spectrum. Eg: shift 16 bits to put value in red spectrum.
-	new_red = (diff_red << 16);
-	new_green = (diff_green << 8);
-	new_blue = (diff_blue);
-	print_diffuse_color = new_red + new_green +new_blue;
+	if (period == 0 || since >= 2*period)
+		return LCD_TE_UNKNOWN;
 
-	return print_diffuse_color;
+	return (since % period) * LCD_TE_LINES / period;
 }
 
-// This method is used to compute the diffuse reflection color with given reflectivity coefficients
-int getDiffuseColorGreen(Pts3D Pi, float reflectivity_r, float reflectivity_g, float reflectivity_b)
+// Lines to wait, with the scan on <line>, before a burst that lasts <lines>
+// lines may write rows y0..y1. 0 when the scan is off those rows and does not
+// get to them before the burst is done. A burst too long to ever fit starts
+// as soon as the scan has left the rows, staying behind it as long as it can.
+uint32_t lcd_te_clear(uint32_t line, uint16_t y0, uint16_t y1, uint32_t lines)
 {
-	uint32_t print_diffuse_color;
-	Pts3D Ps;
-	Ps.x_value = Psx;
-	Ps.y_value = Psy;
-	Ps.z_value = Psz;
-	int diff_red, diff_green, diff_blue;
-	float new_red, new_green, new_blue, scaling = 16000;
-
-	//Calculate the diffuse reflection for point Pi
-	float_t temp = ((Ps.z_value - Pi.z_value)/sqrt(pow((Ps.x_value - Pi.x_value),2) + pow((Ps.y_value - Pi.y_value),2) + pow((Ps.z_value - Pi.z_value),2))) / (pow((Ps.x_value - Pi.x_value),2) + pow((Ps.y_value - Pi.y_value),2) + pow((Ps.z_value - Pi.z_value),2));
+	uint32_t a = LCD_TE_ROW0 + y0, b = LCD_TE_ROW0 + y1;
 
-	//Scale the above result
-	temp *= scaling;
-	diff_red = reflectivity_r * temp * 255;
-	diff_green = reflectivity_g * temp * 255;
-	diff_blue  = reflectivity_b * temp * 255;
+	if (line >= a && line <= b)
+		return b + 1 - line;
 
-	//Shift the above values into their spectrum. Eg: shift 16 bits to put value in red spectrum.
-	new_red = (diff_red << 16);
-	new_green = (diff_green << 8);
-	new_blue = (diff_blue);
-	print_diffuse_color = new_red + new_green +new_blue;
+	if (lines < (a + LCD_TE_LINES - line) % LCD_TE_LINES || lines + b - a + 1 >= LCD_TE_LINES)
+		return 0;
 
-	return print_diffuse_color;
+	return (b + 1 + LCD_TE_LINES - line) % LCD_TE_LINES;
 }
 
-// World to Viewer Transform method
-Pts3D getWorld2Viewer(float WCS_X, float WCS_Y, float WCS_Z)
+// Hold a RAMWR burst of <pixels> pixels into rows y0..y1 until the scan is
+// clear of them. Everything queued before it goes out first, so that the
+// burst starts when the wait ends.
+void lcd_te_gate(uint16_t y0, uint16_t y1, uint32_t pixels)
 {
-	Pts3D V;
+#if LCD_USE_TE
+	uint32_t start, now, line, lines;
 
-	float Rho=sqrt(pow(Xe,2)+pow(Ye,2)+pow(Xe,2));
+	if (lcd_te.period == 0)
+		return;
 
-	float sPheta = Ye/sqrt(pow(Xe,2)+pow(Ye,2));
-	float cPheta = Xe/sqrt(pow(Xe,2)+pow(Ye,2));
-	float sPhi = sqrt(pow(Xe,2)+pow(Ye,2))/Rho;
-	float cPhi = Ze/Rho;
+	lcd_sync();
 
-	V.x_value = -sPheta * WCS_X + cPheta * WCS_Y;
-	V.y_value = -cPheta * cPhi * WCS_X - cPhi * sPheta * WCS_Y + sPhi * WCS_Z;
-	V.z_value = -sPhi * cPheta * WCS_X - sPhi * cPheta * WCS_Y - cPhi * WCS_Z + Rho;
+	start = now = frame_us();
+	lines = pixels * lcd_te.px_ns / 1000 * LCD_TE_LINES / lcd_te.period + 1;
 
-	return V;
+	while ((line = lcd_te_line(now)) != LCD_TE_UNKNOWN && lcd_te_clear(line, y0, y1, lines))
+		now = frame_us();
+
+	if (now != start)
+	{
+		lcd_te.held++;
+		lcd_te.wait += now - start;
+	}
+#endif
 }
 
-// Viewer to Perspective Transform method
-Pts2D getViewer2Perspective(float V_X, float V_Y, float V_Z)
+// Fill a rectangle directly on the panel, bypassing the framebuffer
+void lcd_fillrect(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint32_t color)
+
 {
-	Pts2D P;
+	 int16_t width, height;
 
-	P.x=V_X*(D_focal/V_Z);
-	P.y=V_Y*(D_focal/V_Z);
+	 width = x1-x0+1;
 
-	return P;
-}
+#if LCD_USE_TE
+	 // in bands that fit between two passes of the scan
+	 for (; y0 <= y1; y0 += height) {
 
-// World to Viewer to Perspective Transform method
-Pts2D get3DTransform(Pts3D Pi)
-{
-	float Rho=sqrt(pow(Xe,2)+pow(Ye,2)+pow(Xe,2));
+	  height = (y1-y0+1 < LCD_TE_BAND) ? y1-y0+1 : LCD_TE_BAND;
 
-	typedef struct{
-		float X; float Y; float Z;
-	}pworld;
+	  setAddrWindow(x0,y0,x1,y0+height-1);
 
-	typedef struct{
-		float X; float Y; float Z;
+	  lcd_te_gate(y0,y0+height-1,width*height);
 
-	}pviewer;
+	  writecommand(ST7735_RAMWR);
 
-	typedef struct{
-		float X; float Y;
-	}pperspective;
+	  writecolor(color,width*height);
 
-	pworld world;
-	pviewer viewer;
-	pperspective perspective;
+	 }
+#else
+	 height = y1-y0+1;
 
-	world.X = Pi.x_value;
-	world.Y = Pi.y_value;
-	world.Z = Pi.z_value;
+	 setAddrWindow(x0,y0,x1,y1);
 
-	float sPheta = Ye/sqrt(pow(Xe,2)+pow(Ye,2));
-	float cPheta = Xe/sqrt(pow(Xe,2)+pow(Ye,2));
-	float sPhi = sqrt(pow(Xe,2)+pow(Ye,2))/Rho;
-	float cPhi = Ze/Rho;
+	 writecommand(ST7735_RAMWR);
 
-	viewer.X=-sPheta*world.X+cPheta*world.Y;
-	viewer.Y = -cPheta * cPhi * world.X - cPhi * sPheta * world.Y + sPhi * world.Z;
-	viewer.Z = -sPhi * cPheta * world.X - sPhi * cPheta * world.Y-cPheta * world.Z + Rho;
+	 writecolor(color,width*height);
+#endif
 
-	perspective.X=D_focal*viewer.X/viewer.Z;
-	perspective.Y=D_focal*viewer.Y/viewer.Z;
+}
+
+void lcddelay(int ms)
+
+{
+	 int count = 24000;
+	 int i;
+	 for ( i = count*ms; i > 0; i--);
+}
+
+void lcd_init()
+
+{
+	 int i;
+	 printf("Welcome to my CMPE240 Project - 3D_Shading_and_Diffuse_Reflection\n");
+	 printf("First Name: Tirumala Saiteja Goruganthu\n");
+	 printf("Last Name: Goruganthu\n");
+	 printf("SJSU ID: 016707210\n");
+	 // Set pins P0.16, P0.3, P0.22 as output
+	 LPC_GPIO0->FIODIR |= (0x1<<16);
+
+	 LPC_GPIO0->FIODIR |= (0x1<<3);
+
+	 LPC_GPIO0->FIODIR |= (0x1<<22);
+
+	 // Hardware Reset Sequence
+	 LPC_GPIO0->FIOSET |= (0x1<<22);
+	 lcddelay(500);
+
+	 LPC_GPIO0->FIOCLR |= (0x1<<22);
+	 lcddelay(500);
+
+	 LPC_GPIO0->FIOSET |= (0x1<<22);
+	 lcddelay(500);
+
+	 // nothing is known about the panel's address window after reset
+	 lcd_win.valid = 0;
+	 lcd_win.writing = 0;
+
+	 // the first queued frame sets D/C and the frame size
+	 lcd_mode = 0;
+	 SSPQueueSetHook( 0, lcd_txmark );
+
+	 // initialize buffers
+	 for ( i = 0; i < SSP_BUFSIZE; i++ )
+	 {
+
+	   src_addr[i] = 0;
+	   dest_addr[i] = 0;
+	 }
+
+	 // Take LCD display out of sleep mode
+	 writecommand(ST7735_SLPOUT);
+	 lcddelay(200);
+
+	 // Select the pixel format
+	 writecommand(ST7735_COLMOD);
+	 writedata(LCD_COLMOD_VALUE);
+	 lcddelay(10);
+
+	 // Turn LCD display on
+	 writecommand(ST7735_DISPON);
+	 lcddelay(200);
+
+	 lcd_sync();
+
+}
+
+/*****************************************************************************
+
+** Tiled framebuffer
+
+** Every tile is UNKNOWN, SOLID or BUFFERED. A BUFFERED tile keeps its pixels
+** as SSP frames (lcdword) plus a coverage mask of the pixels whose value is
+** known, and a dirty box of what changed since the last flush. A dirty SOLID
+** tile still has to be filled on the panel. Drawing into a SOLID tile starts
+** from its color so the whole tile is known, drawing into an UNKNOWN tile
+** only knows the pixels that were drawn.
+
+*****************************************************************************/
+
+typedef struct
+{
+	uint8_t state; uint8_t slot; uint8_t dirty;
+	uint8_t dx0; uint8_t dy0; uint8_t dx1; uint8_t dy1;
+	uint32_t color;
+}fbtile;
+
+__BSS(RAM2) static lcdword fb_pool[FB_POOL_TILES][FB_TILE_WORDS];
+__BSS(RAM2) static SSP_DMA_LLI fb_lli[FB_TILE_H];
+static uint16_t fb_cover[FB_POOL_TILES][FB_TILE_H];
+static int8_t fb_owner[FB_POOL_TILES];
+static fbtile fb_tiles[FB_TILES_X*FB_TILES_Y];
+static uint8_t fb_victim = 0;
+
+void fb_init()
+{
+	int i;
+
+	for(i = 0; i < FB_TILES_X*FB_TILES_Y; i++)
+	{
+		fb_tiles[i].state = FB_TILE_UNKNOWN;
+		fb_tiles[i].dirty = 0;
+	}
+	for(i = 0; i < FB_POOL_TILES; i++)
+		fb_owner[i] = -1;
+}
+
+// Send rows of <width> pixels of a buffered tile that lie inside the current
+// address window
+void fb_write_rows(lcdword *first, uint16_t width, uint16_t rows)
+{
+	int i;
+
+	lcd_te_gate(lcd_win.y0, lcd_win.y0 + rows - 1, width*rows);
+
+	writecommand(ST7735_RAMWR);
+
+	lcd_advance(width*rows);
+
+	if (width*rows >= LCD_DMA_MIN_PIXELS)
+	{
+		lcd_direct();
+		for(i = 0; i < rows; i++)
+			SSP0DMALink(&fb_lli[i], (uint8_t *)(first + i*FB_TILE_W*LCD_WORDS), width*LCD_BPP, (i + 1 < rows) ? &fb_lli[i + 1] : 0);
+		if (SSP0DMASendList(fb_lli, lcd_dma_done))
+			return;
+	}
+
+	lcd_setmode(LCD_MODE_DATA | LCD_FRAME_BITS);
+
+	for(i = 0; i < rows; i++)
+#if LCD_COLOR_565
+		SSPQueueSend16( 0, first + i*FB_TILE_W, width );
+#else
+		SSPQueueSend( 0, first + i*FB_TILE_W*LCD_WORDS, width*LCD_WORDS );
+#endif
+}
+
+// Is tile t a dirty SOLID tile of the given color
+int fb_solid_pending(int t, uint32_t color)
+{
+	return fb_tiles[t].dirty && fb_tiles[t].state == FB_TILE_SOLID && fb_tiles[t].color == color;
+}
+
+// Fill a dirty SOLID tile on the panel, together with the dirty SOLID tiles
+// of the same color right of it and the rows of them below, in one window
+void fb_flush_solid(int t)
+{
+	int tx = t % FB_TILES_X, ty = t / FB_TILES_X;
+	int tx1 = tx, ty1 = ty, x;
+	uint32_t color = fb_tiles[t].color;
+
+	while (tx1 + 1 < FB_TILES_X && fb_solid_pending(t + tx1 + 1 - tx, color))
+		tx1++;
+
+	for(; ty1 + 1 < FB_TILES_Y; ty1++)
+	{
+		for(x = tx; x <= tx1; x++)
+			if (!fb_solid_pending((ty1 + 1)*FB_TILES_X + x, color))
+				break;
+		if (x <= tx1)
+			break;
+	}
+
+	for(; ty <= ty1; ty++)
+		for(x = tx; x <= tx1; x++)
+			fb_tiles[ty*FB_TILES_X + x].dirty = 0;
+
+	lcd_fillrect(tx*FB_TILE_W, (t / FB_TILES_X)*FB_TILE_H, (tx1 + 1)*FB_TILE_W - 1, (ty1 + 1)*FB_TILE_H - 1, color);
+}
+
+// Send the dirty box of tile t, one address window when every pixel of the
+// box is known, otherwise one window per run of known pixels
+void fb_flush_tile(int t)
+{
+	fbtile *tile = &fb_tiles[t];
+	lcdword *buf = fb_pool[tile->slot];
+	uint16_t *cover = fb_cover[tile->slot];
+	uint16_t x0 = (t % FB_TILES_X)*FB_TILE_W;
+	uint16_t y0 = (t / FB_TILES_X)*FB_TILE_H;
+	uint32_t mask = ((1UL << (tile->dx1 + 1)) - 1) & ~((1UL << tile->dx0) - 1);
+	int x, y, run, full = 1;
+
+	if (tile->state == FB_TILE_SOLID)
+	{
+		fb_flush_solid(t);
+		return;
+	}
+
+	for(y = tile->dy0; y <= tile->dy1; y++)
+		if ((cover[y] & mask) != mask)
+			full = 0;
+
+	if (full)
+	{
+		setAddrWindow(x0 + tile->dx0, y0 + tile->dy0, x0 + tile->dx1, y0 + tile->dy1);
+		fb_write_rows(buf + (tile->dy0*FB_TILE_W + tile->dx0)*LCD_WORDS, tile->dx1 - tile->dx0 + 1, tile->dy1 - tile->dy0 + 1);
+	}
+	else
+	{
+		for(y = tile->dy0; y <= tile->dy1; y++)
+			for(x = tile->dx0; x <= tile->dx1; x += run)
+			{
+				run = 1;
+				if (!(cover[y] & (1 << x)))
+					continue;
+				while (x + run <= tile->dx1 && (cover[y] & (1 << (x + run))))
+					run++;
+				setAddrWindow(x0 + x, y0 + y, x0 + x + run - 1, y0 + y);
+				fb_write_rows(buf + (y*FB_TILE_W + x)*LCD_WORDS, run, 1);
+			}
+	}
+	tile->dirty = 0;
+}
+
+// Send every dirty tile to the panel
+void fb_flush()
+{
+	int t;
+
+	for(t = 0; t < FB_TILES_X*FB_TILES_Y; t++)
+		if (fb_tiles[t].dirty)
+			fb_flush_tile(t);
+}
+
+// Give tile t a pool slot, flushing and evicting another tile when the pool
+// is exhausted. An evicted tile is clean and becomes UNKNOWN.
+void fb_alloc(int t)
+{
+	fbtile *tile = &fb_tiles[t];
+	int s, i;
+	lcdword *p;
+
+	for(s = 0; s < FB_POOL_TILES; s++)
+		if (fb_owner[s] < 0)
+			break;
+
+	if (s == FB_POOL_TILES)
+	{
+		fb_flush();
+		s = fb_victim;
+		fb_victim = (fb_victim + 1) % FB_POOL_TILES;
+		fb_tiles[fb_owner[s]].state = FB_TILE_UNKNOWN;
+	}
+
+	// a pending DMA flush may still be reading this slot
+	SSP0DMAWait();
+
+	fb_owner[s] = t;
+	if (tile->state == FB_TILE_SOLID)
+	{
+		p = fb_pool[s];
+		for(i = 0; i < FB_TILE_W*FB_TILE_H; i++, p += LCD_WORDS)
+			lcd_pack(tile->color, p);
+		for(i = 0; i < FB_TILE_H; i++)
+			fb_cover[s][i] = 0xFFFF;
+	}
+	else
+	{
+		for(i = 0; i < FB_TILE_H; i++)
+			fb_cover[s][i] = 0;
+	}
+	tile->state = FB_TILE_BUFFERED;
+	tile->slot = s;
+}
+
+// Release the pool slot of tile t, if any
+void fb_release(int t)
+{
+	if (fb_tiles[t].state == FB_TILE_BUFFERED)
+		fb_owner[fb_tiles[t].slot] = -1;
+}
+
+// Grow the dirty box of a tile by the tile-local box (tx0,ty0)-(tx1,ty1)
+void fb_mark(fbtile *tile, uint8_t tx0, uint8_t ty0, uint8_t tx1, uint8_t ty1)
+{
+	if (!tile->dirty)
+	{
+		tile->dirty = 1;
+		tile->dx0 = tx0; tile->dx1 = tx1;
+		tile->dy0 = ty0; tile->dy1 = ty1;
+	}
+	else
+	{
+		if (tx0 < tile->dx0) tile->dx0 = tx0;
+		if (tx1 > tile->dx1) tile->dx1 = tx1;
+		if (ty0 < tile->dy0) tile->dy0 = ty0;
+		if (ty1 > tile->dy1) tile->dy1 = ty1;
+	}
+}
+
+// Plot a pixel at physical coordinates (x,y) into the framebuffer
+void fb_plot(int16_t x, int16_t y, uint32_t color)
+{
+	int t = (y / FB_TILE_H)*FB_TILES_X + (x / FB_TILE_W);
+	fbtile *tile = &fb_tiles[t];
+	uint8_t tx = x % FB_TILE_W, ty = y % FB_TILE_H;
+	lcdword *p;
+
+	if (tile->state != FB_TILE_BUFFERED)
+	{
+		if (tile->state == FB_TILE_SOLID && tile->color == color)
+			return;
+		fb_alloc(t);
+	}
+
+	p = &fb_pool[tile->slot][(ty*FB_TILE_W + tx)*LCD_WORDS];
+#if LCD_COLOR_565
+	p[0] = color;
+#else
+	p[0] = color >> 16;
+	p[1] = (color >> 8) & 0xFF;
+	p[2] = color & 0xFF;
+#endif
+	fb_cover[tile->slot][ty] |= (1 << tx);
+
+	fb_mark(tile, tx, ty, tx, ty);
+}
+
+// Draw the physical row y from x0 to x1 (already clipped) into the
+// framebuffer, one tile segment at a time
+void fb_hspan(int16_t x0, int16_t x1, int16_t y, uint32_t color)
+{
+	lcdword pixel[LCD_WORDS], *p;
+	uint8_t ty = y % FB_TILE_H;
+	uint8_t tx0, tx1;
+	fbtile *tile;
+	int t, i, k;
+
+	lcd_pack(color, pixel);
+
+	while (x0 <= x1)
+	{
+		t = (y / FB_TILE_H)*FB_TILES_X + (x0 / FB_TILE_W);
+		tile = &fb_tiles[t];
+		tx0 = x0 % FB_TILE_W;
+		tx1 = (x1 - x0 + tx0 < FB_TILE_W) ? x1 - x0 + tx0 : FB_TILE_W - 1;
+		x0 += tx1 - tx0 + 1;
+
+		if (tile->state != FB_TILE_BUFFERED)
+		{
+			if (tile->state == FB_TILE_SOLID && tile->color == color)
+				continue;
+			fb_alloc(t);
+		}
+
+		p = &fb_pool[tile->slot][(ty*FB_TILE_W + tx0)*LCD_WORDS];
+		for(i = tx0; i <= tx1; i++)
+			for(k = 0; k < LCD_WORDS; k++)
+				*p++ = pixel[k];
+		fb_cover[tile->slot][ty] |= ((1UL << (tx1 + 1)) - 1) & ~((1UL << tx0) - 1);
+
+		fb_mark(tile, tx0, ty, tx1, ty);
+	}
+}
+
+// Fill a rectangle in physical coordinates. Tiles it covers completely turn
+// SOLID and are left dirty for fb_flush() to fill on the panel, partly
+// covered tiles are drawn into their buffers.
+void fb_fill(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint32_t color)
+{
+	int16_t tx0, ty0, tx1, ty1, x, y;
+	int t;
+
+	if (x0 < 0) x0 = 0;
+	if (y0 < 0) y0 = 0;
+	if (x1 > ST7735_TFTWIDTH) x1 = ST7735_TFTWIDTH;
+	if (y1 > ST7735_TFTHEIGHT) y1 = ST7735_TFTHEIGHT;
+	if (x0 > x1 || y0 > y1)
+		return;
+
+	// range of tiles that are covered completely
+	tx0 = (x0 + FB_TILE_W - 1) / FB_TILE_W;
+	ty0 = (y0 + FB_TILE_H - 1) / FB_TILE_H;
+	tx1 = (x1 + 1) / FB_TILE_W - 1;
+	ty1 = (y1 + 1) / FB_TILE_H - 1;
+
+	for(y = y0; y <= y1; y++)
+	{
+		if (tx0 <= tx1 && y/FB_TILE_H >= ty0 && y/FB_TILE_H <= ty1)
+		{
+			// only the parts left and right of the solid tiles
+			if (x0 < tx0*FB_TILE_W)
+				fb_hspan(x0, tx0*FB_TILE_W - 1, y, color);
+			if (x1 > (tx1 + 1)*FB_TILE_W - 1)
+				fb_hspan((tx1 + 1)*FB_TILE_W, x1, y, color);
+		}
+		else
+			fb_hspan(x0, x1, y, color);
+	}
+
+	if (tx0 > tx1 || ty0 > ty1)
+		return;
+
+	for(y = ty0; y <= ty1; y++)
+		for(x = tx0; x <= tx1; x++)
+		{
+			t = y*FB_TILES_X + x;
+			fb_release(t);
+			fb_tiles[t].state = FB_TILE_SOLID;
+			fb_tiles[t].color = color;
+			fb_mark(&fb_tiles[t], 0, 0, FB_TILE_W - 1, FB_TILE_H - 1);
+		}
+}
+
+/*****************************************************************************
+
+** Depth buffer
+
+** Depth is kept per tile, like the framebuffer: a tile gets a slot of
+** 16x16 depth values the first time a depth-tested pixel lands in it.
+** Values grow toward the eye (0 is the far plane, which is what a new slot
+** is cleared to), so the test is a single compare. When the pool runs out
+** the remaining tiles are not tracked and fall back to drawing order.
+** Geometry that nothing else is depth tested against afterwards can clear
+** zb_write: it is still tested, but never takes a slot or updates depth.
+**
+** Lines and outlines are not depth tested, but the background's can leave
+** a depth for the polygons drawn after them: while zb_ink is set, the runs
+** a display list records carry it. Once the background has a list, a tile
+** that gets a slot starts out with the depth of the list's runs in it
+** rather than the far plane, so only the tiles the cube and its shadow
+** reach take room in the pool. Without a list the background leaves no
+** depth and is drawn over like the ground.
+
+*****************************************************************************/
+
+#define ZB_NONE 0xFF
+
+static uint16_t zb_pool[ZB_POOL_TILES][FB_TILE_W*FB_TILE_H];
+static uint8_t zb_slot[FB_TILES_X*FB_TILES_Y];
+static uint8_t zb_used = 0;
+uint8_t zb_write = 1;
+
+// Depth display lists record with what is drawn next, 0 for none
+uint16_t zb_ink = 0;
+
+// Tiles the background's display list has depth for, see dl_depth()
+static uint8_t zb_listed[FB_TILES_X*FB_TILES_Y];
+
+void dl_depth(int t, uint16_t *depth);
+
+// Start a new frame, every tile is empty
+void zb_clear()
+{
+	int i;
+
+	for(i = 0; i < FB_TILES_X*FB_TILES_Y; i++)
+		zb_slot[i] = ZB_NONE;
+	zb_used = 0;
+	zb_write = 1;
+}
+
+// Depth test pixel (x,y) in physical coordinates. Returns 1 and stores z if
+// the pixel is at least as near as what is there, 0 if it is hidden.
+int zb_test(int16_t x, int16_t y, uint16_t z)
+{
+	int t = (y / FB_TILE_H)*FB_TILES_X + (x / FB_TILE_W);
+	uint16_t *zp;
+	int i;
+
+	if ((x < 0) || (x >= _width) || (y < 0) || (y >= _height))
+		return 0;
+
+	if (zb_slot[t] == ZB_NONE)
+	{
+		if ((!zb_write && !zb_listed[t]) || zb_used == ZB_POOL_TILES)
+			return 1;
+		zb_slot[t] = zb_used++;
+		for(i = 0; i < FB_TILE_W*FB_TILE_H; i++)
+			zb_pool[zb_slot[t]][i] = 0;
+		if (zb_listed[t])
+			dl_depth(t, zb_pool[zb_slot[t]]);
+	}
+
+	zp = &zb_pool[zb_slot[t]][(y % FB_TILE_H)*FB_TILE_W + (x % FB_TILE_W)];
+	if (z < *zp)
+		return 0;
+
+	if (zb_write)
+		*zp = z;
+	return 1;
+}
+
+/*****************************************************************************
+
+** Display lists
+
+** A display list records what a part of the scene drew, as clipped physical
+** runs in drawing order: a row run from (x,y) to (end,y) or a column run
+** from (x,y) to (x,end). A pixel or span that continues the last run in the
+** same color and depth is merged into it, so contours and Bresenham runs
+** take one entry each. Colors are kept in a small per-list palette so an
+** entry fits in six bytes with the zb_ink it was drawn with. Replaying a
+** list repaints the same pixels without running the transform, lighting
+** and rasterizing code again, which suits static parts of the scene like
+** the sphere. Replaying into a clip box repaints just the part of the list
+** inside it.
+**
+** dl_add() sees every primitive drawn, so it also keeps track of the screen
+** box a moving object covers: while a box is tracked with dl_track(), each
+** rectangle drawn grows it.
+
+*****************************************************************************/
+
+#define DL_PALETTE 128			// every ink value below DL_INK_COLUMN, the 18-bit background shades take 122
+#define DL_INK_COLUMN 0x80		// run goes down instead of right
+
+typedef struct
+{
+	uint8_t x; uint8_t y; uint8_t end;
+	uint8_t ink;				// palette index | DL_INK_COLUMN
+	uint16_t z;					// zb_ink
+}dlrun;
+
+typedef struct
+{
+	dlrun *run;
+	uint16_t size; uint16_t count;
+	lcdcolor palette[DL_PALETTE];
+	uint8_t colors; uint8_t ink;
+	uint8_t overflow;
+}displaylist;
+
+// Box in physical coordinates, empty when x0 > x1
+typedef struct
+{
+	int16_t x0; int16_t y0; int16_t x1; int16_t y1;
+}scrbox;
+
+// list being recorded, 0 when not recording
+static displaylist *dl_rec = 0;
+
+// box grown by what is drawn, 0 when not tracking
+static scrbox *dl_box = 0;
+
+void scrbox_empty(scrbox *b)
+{
+	b->x0 = b->y0 = 0;
+	b->x1 = b->y1 = -1;
+}
+
+// Grow <box> by everything drawn from now on, until dl_track(0)
+void dl_track(scrbox *box)
+{
+	dl_box = box;
+}
+
+// Start recording into <dl>, using <buf> of <size> entries as storage
+void dl_begin(displaylist *dl, dlrun *buf, uint16_t size)
+{
+	dl->run = buf;
+	dl->size = size;
+	dl->count = 0;
+	dl->colors = 0;
+	dl->ink = 0;
+	dl->overflow = 0;
+	dl_rec = dl;
+}
+
+// Stop recording. Returns 1 if the list holds everything drawn since
+// dl_begin(), 0 if it ran out of entries or colors and can't be replayed.
+int dl_end()
+{
+	displaylist *dl = dl_rec;
+
+	dl_rec = 0;
+	return dl != 0 && !dl->overflow;
+}
+
+// Palette index of <color>, added to the palette if it is new. Returns -1
+// when the palette is full.
+int dl_ink(displaylist *dl, uint32_t color)
+{
+	int i;
+
+	if (dl->colors && dl->palette[dl->ink] == color)
+		return dl->ink;
+
+	for(i = 0; i < dl->colors; i++)
+		if (dl->palette[i] == color)
+			break;
+
+	if (i == dl->colors)
+	{
+		if (dl->colors == DL_PALETTE)
+			return -1;
+		dl->palette[dl->colors++] = color;
+	}
+	dl->ink = i;
+	return i;
+}
+
+// Append a row run (column == 0) or column run to the list being recorded
+void dl_run(displaylist *dl, uint8_t x, uint8_t y, uint8_t end, uint8_t column, uint32_t color)
+{
+	dlrun *r;
+	uint8_t *start, first;
+	int ink = dl_ink(dl, color);
+
+	if (ink < 0)
+	{
+		dl->overflow = 1;
+		return;
+	}
+
+	if (dl->count)
+	{
+		r = &dl->run[dl->count - 1];
+
+		// a single pixel followed by the pixel or column right below it
+		if (r->z == zb_ink && r->ink == ink && r->end == r->x && (column || end == x) && x == r->x && y == r->y + 1)
+		{
+			r->ink = ink | DL_INK_COLUMN;
+			r->end = column ? end : y;
+			return;
+		}
+
+		// same color, depth and direction on the same line, overlapping or touching
+		if (r->z == zb_ink && r->ink == (ink | (column ? DL_INK_COLUMN : 0)) && (column ? x == r->x : y == r->y))
+		{
+			start = column ? &r->y : &r->x;
+			first = column ? y : x;
+			if (first <= r->end + 1 && end + 1 >= *start)
+			{
+				if (first < *start) *start = first;
+				if (end > r->end) r->end = end;
+				return;
+			}
+		}
+	}
+
+	if (dl->count == dl->size)
+	{
+		dl->overflow = 1;
+		return;
+	}
+
+	r = &dl->run[dl->count++];
+	r->x = x; r->y = y; r->end = end;
+	r->ink = ink | (column ? DL_INK_COLUMN : 0);
+	r->z = zb_ink;
+}
+
+// Record the physical rectangle (x0,y0)-(x1,y1), clipped to the panel, in
+// the list being recorded and the box being tracked. Rectangles wider than
+// one column go in as rows.
+void dl_add(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint32_t color)
+{
+	displaylist *dl = dl_rec;
+	scrbox *b = dl_box;
+	int16_t y;
+
+	if (b == 0 && (dl == 0 || dl->overflow))
+		return;
+
+	if (x0 < 0) x0 = 0;
+	if (y0 < 0) y0 = 0;
+	if (x1 > ST7735_TFTWIDTH) x1 = ST7735_TFTWIDTH;
+	if (y1 > ST7735_TFTHEIGHT) y1 = ST7735_TFTHEIGHT;
+	if (x0 > x1 || y0 > y1)
+		return;
+
+	if (b)
+	{
+		if (b->x0 > b->x1)
+		{
+			b->x0 = x0; b->x1 = x1;
+			b->y0 = y0; b->y1 = y1;
+		}
+		else
+		{
+			if (x0 < b->x0) b->x0 = x0;
+			if (x1 > b->x1) b->x1 = x1;
+			if (y0 < b->y0) b->y0 = y0;
+			if (y1 > b->y1) b->y1 = y1;
+		}
+	}
+
+	if (dl == 0 || dl->overflow)
+		return;
+
+	if (x0 == x1 && y0 != y1)
+	{
+		dl_run(dl, x0, y0, y1, 1, color);
+		return;
+	}
+	for(y = y0; y <= y1; y++)
+		dl_run(dl, x0, y, x1, 0, color);
+}
+
+void fillrect(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint32_t color)
+
+{
+	dl_add(x0, y0, x1, y1, color);
+
+#if USE_FRAMEBUFFER
+	fb_fill(x0, y0, x1, y1, color);
+#else
+	lcd_fillrect(x0, y0, x1, y1, color);
+#endif
+}
+
+// Draw a recorded list again, in the order it was recorded. With a <clip>
+// box only the runs inside it are drawn, cut down to it. Pixels and row
+// runs are on the panel already and go straight into the framebuffer.
+void dl_play(displaylist *dl, const scrbox *clip)
+{
+	static const scrbox all = {0, 0, ST7735_TFTWIDTH, ST7735_TFTHEIGHT};
+	int16_t x0, y0, x1, y1;
+	uint32_t color;
+	dlrun *r;
+	int i;
+
+	if (clip == 0)
+		clip = &all;
+
+	for(i = 0, r = dl->run; i < dl->count; i++, r++)
+	{
+		x0 = r->x; y0 = r->y;
+		x1 = (r->ink & DL_INK_COLUMN) ? r->x : r->end;
+		y1 = (r->ink & DL_INK_COLUMN) ? r->end : r->y;
+
+		if (x0 < clip->x0) x0 = clip->x0;
+		if (y0 < clip->y0) y0 = clip->y0;
+		if (x1 > clip->x1) x1 = clip->x1;
+		if (y1 > clip->y1) y1 = clip->y1;
+		if (x0 > x1 || y0 > y1)
+			continue;
+
+		color = dl->palette[r->ink & ~DL_INK_COLUMN];
+
+#if USE_FRAMEBUFFER
+		if (y0 == y1)
+		{
+			dl_add(x0, y0, x1, y1, color);
+			if (x0 == x1)
+				fb_plot(x0, y0, color);
+			else
+				fb_hspan(x0, x1, y0, color);
+			continue;
+		}
+#endif
+		fillrect(x0, y0, x1, y1, color);
+	}
+}
+
+// The list the depth buffer takes the background's depth from, 0 for none
+static const displaylist *dl_zb = 0;
+
+// Runs of <dl> are on the panel from now on, with the depth they were
+// recorded with. Tiles they have depth in are marked for zb_test().
+void dl_depth_from(const displaylist *dl)
+{
+	const dlrun *r;
+	int i, x, y, x1, y1;
+
+	dl_zb = dl;
+	memset(zb_listed, 0, sizeof(zb_listed));
+
+	for(i = 0, r = dl->run; i < dl->count; i++, r++)
+	{
+		if (r->z == 0)
+			continue;
+
+		x1 = (r->ink & DL_INK_COLUMN) ? r->x : r->end;
+		y1 = (r->ink & DL_INK_COLUMN) ? r->end : r->y;
+		for(y = r->y / FB_TILE_H; y <= y1 / FB_TILE_H && y < FB_TILES_Y; y++)
+			for(x = r->x / FB_TILE_W; x <= x1 / FB_TILE_W && x < FB_TILES_X; x++)
+				zb_listed[y*FB_TILES_X + x] = 1;
+	}
+}
+
+// Store the depth the runs of dl_zb leave in tile t into <depth>, the
+// tile's fresh depth slot. Like the color, the depth of a pixel is that of
+// the last run over it, so a run without depth drawn over one with depth
+// leaves the pixel at the far plane.
+void dl_depth(int t, uint16_t *depth)
+{
+	int16_t tx = (t % FB_TILES_X)*FB_TILE_W, ty = (t / FB_TILES_X)*FB_TILE_H;
+	int16_t x0, y0, x1, y1, x, y;
+	const dlrun *r;
+	int i;
+
+	if (dl_zb == 0)
+		return;
+
+	for(i = 0, r = dl_zb->run; i < dl_zb->count; i++, r++)
+	{
+		x0 = r->x; y0 = r->y;
+		x1 = (r->ink & DL_INK_COLUMN) ? r->x : r->end;
+		y1 = (r->ink & DL_INK_COLUMN) ? r->end : r->y;
+
+		if (x0 < tx) x0 = tx;
+		if (y0 < ty) y0 = ty;
+		if (x1 > tx + FB_TILE_W - 1) x1 = tx + FB_TILE_W - 1;
+		if (y1 > ty + FB_TILE_H - 1) y1 = ty + FB_TILE_H - 1;
+
+		for(y = y0; y <= y1; y++)
+			for(x = x0; x <= x1; x++)
+				depth[(y - ty)*FB_TILE_W + (x - tx)] = r->z;
+	}
+}
+
+// Read the 24-bit display ID. The panel inserts one dummy clock before the
+// ID, so 32 bits are clocked in and shifted back by one.
+uint32_t lcd_read_id()
+
+{
+	 uint8_t id[4];
+
+	 int pnum = 0;
+
+	 lcd_sync();
+
+	 LPC_GPIO0->FIOCLR |= (0x1<<3);
+
+	 SSP_SSELToggle( pnum, 0 );
+
+	 src_addr[0] = ST7735_RDDID;
+
+	 SSPSetFrameSize( pnum, 8 );
+
+	 SSPSend( pnum, (uint8_t *)src_addr, 1 );
+
+	 LPC_GPIO0->FIOSET |= (0x1<<3);
+
+	 SSPReceive( pnum, id, 4 );
+
+	 SSP_SSELToggle( pnum, 1 );
+
+	 lcd_win.writing = 0;
+
+	 lcd_mode = LCD_MODE_DATA | 8;
+
+	 return ((((uint32_t)id[0] << 24) | (id[1] << 16) | (id[2] << 8) | id[3]) >> 7) & 0xFFFFFF;
+
+}
+
+// Find the fastest SPI clock at which RDDID still reads back the value seen
+// at LCD_SPI_SAFE_HZ, every step must pass LCD_SPI_TUNE_READS reads. Steps
+// that land on a rate already tried are skipped.
+uint32_t lcd_tune_spi()
+
+{
+	 uint32_t ref, hz, rate, max, good;
+
+	 int i;
+
+	 max = SSPSetClock(0, LCD_SPI_TUNE_MAX_HZ);
+
+	 good = SSPSetClock(0, LCD_SPI_SAFE_HZ);
+
+	 ref = lcd_read_id();
+
+	 if (ref == 0 || ref == 0xFFFFFF)
+
+	  return SSPSetClock(0, LCD_SPI_HZ);
+
+	 for (hz = good + LCD_SPI_TUNE_STEP; good < max; hz += LCD_SPI_TUNE_STEP) {
+
+	  rate = SSPSetClock(0, hz);
+
+	  if (rate <= good)
+
+	   continue;
+
+	  for (i = 0; i < LCD_SPI_TUNE_READS; i++)
+
+	   if (lcd_read_id() != ref)
+
+	    break;
+
+	  if (i < LCD_SPI_TUNE_READS)
+
+	   break;
+
+	  good = rate;
+
+	 }
+
+	 return SSPSetClock(0, good);
+
+}
+
+// Visible part of the panel in virtual coordinates
+#define VIEW_XMIN (-(_width>>1))
+#define VIEW_XMAX (_width - 1 - (_width>>1))
+#define VIEW_YMIN ((_height>>1) - (_height - 1))
+#define VIEW_YMAX (_height>>1)
+
+// Converting virtual X-Coordinate to physical X-Coordinate
+int16_t xConvertToPhysical(int16_t x)
+{
+	x = x + (_width>>1);
+	return x;
+}
+
+// Converting virtual Y-Coordinate to physical Y-Coordinate
+int16_t yConvertToPhysical(int16_t y)
+{
+	y = (_height>>1) - y;
+	return y;
+}
+
+void drawPixel(int16_t x, int16_t y, uint32_t color)
+
+{
+	// Convert Virtual to Physical
+	x=xConvertToPhysical(x);
+	y=yConvertToPhysical(y);
+
+	 if ((x < 0) || (x >= _width) || (y < 0) || (y >= _height))
+
+	 return;
+
+	 dl_add(x, y, x, y, color);
+
+#if USE_FRAMEBUFFER
+	 fb_plot(x, y, color);
+
+	 return;
+#endif
+
+	 lcd_seek(x, y);
+
+	 writecolor(color, 1);
+
+}
+
+// Draw a horizontal run of pixels from (x0,y) to (x1,y) in virtual
+// coordinates with a single address window
+void drawHSpan(int16_t x0, int16_t x1, int16_t y, uint32_t color)
+
+{
+	 if (x0 > x1)
+
+	  swap(x0, x1);
+
+	 // Convert Virtual to Physical
+	 x0 = xConvertToPhysical(x0);
+	 x1 = xConvertToPhysical(x1);
+	 y = yConvertToPhysical(y);
+
+	 if ((y < 0) || (y >= _height) || (x1 < 0) || (x0 >= _width))
+
+	 return;
+
+	 if (x0 < 0)
+
+	  x0 = 0;
+
+	 if (x1 >= _width)
+
+	  x1 = _width - 1;
+
+	 dl_add(x0, y, x1, y, color);
+
+#if USE_FRAMEBUFFER
+	 fb_hspan(x0, x1, y, color);
+#else
+	 lcd_fillrect(x0, y, x1, y, color);
+#endif
+
+}
+
+// Draw a vertical run of pixels from (x,y0) to (x,y1) in virtual
+// coordinates with a single address window
+void drawVSpan(int16_t x, int16_t y0, int16_t y1, uint32_t color)
+
+{
+	 int16_t y;
+
+	 if (y0 < y1)
+
+	  swap(y0, y1);
+
+	 // Convert Virtual to Physical, the y axis flips so y0 becomes the top
+	 x = xConvertToPhysical(x);
+	 y0 = yConvertToPhysical(y0);
+	 y1 = yConvertToPhysical(y1);
+
+	 if ((x < 0) || (x >= _width) || (y1 < 0) || (y0 >= _height))
+
+	 return;
+
+	 if (y0 < 0)
+
+	  y0 = 0;
+
+	 if (y1 >= _height)
+
+	  y1 = _height - 1;
+
+	 dl_add(x, y0, x, y1, color);
+
+#if USE_FRAMEBUFFER
+	 for (y = y0; y <= y1; y++)
+
+	  fb_plot(x, y, color);
+#else
+	 (void)y;
+
+	 lcd_fillrect(x, y0, x, y1, color);
+#endif
+
+}
+
+// Horizontal run from (x0,y) to (x1,y) in virtual coordinates, x0 <= x1,
+// that is known to be on the panel (a clipped line): nothing is checked
+void putHSpan(int16_t x0, int16_t x1, int16_t y, uint32_t color)
+
+{
+	 x0 = xConvertToPhysical(x0);
+	 x1 = xConvertToPhysical(x1);
+	 y = yConvertToPhysical(y);
+
+	 dl_add(x0, y, x1, y, color);
+
+#if USE_FRAMEBUFFER
+	 fb_hspan(x0, x1, y, color);
+#else
+	 lcd_fillrect(x0, y, x1, y, color);
+#endif
+
+}
+
+// Vertical run from (x,y0) to (x,y1) in virtual coordinates, y0 <= y1,
+// that is known to be on the panel: nothing is checked
+void putVSpan(int16_t x, int16_t y0, int16_t y1, uint32_t color)
+
+{
+	 int16_t y, top, bottom;
+
+	 // the y axis flips, so y1 becomes the top
+	 x = xConvertToPhysical(x);
+	 top = yConvertToPhysical(y1);
+	 bottom = yConvertToPhysical(y0);
+
+	 dl_add(x, top, x, bottom, color);
+
+#if USE_FRAMEBUFFER
+	 for (y = top; y <= bottom; y++)
+
+	  fb_plot(x, y, color);
+#else
+	 (void)y;
+
+	 lcd_fillrect(x, top, x, bottom, color);
+#endif
+
+}
+
+/*****************************************************************************
+
+
+** Descriptions:        Draw line function
+
+**
+
+** parameters:           Starting point (x0,y0), Ending point(x1,y1) and color
+
+** Returned value:        None
+
+**
+
+*****************************************************************************/
+
+
+// Cohen-Sutherland region code of a point against the visible panel
+#define CLIP_LEFT 1
+#define CLIP_RIGHT 2
+#define CLIP_BOTTOM 4
+#define CLIP_TOP 8
+
+uint8_t clipCode(int16_t x, int16_t y)
+{
+	uint8_t code = 0;
+
+	if (x < VIEW_XMIN) code |= CLIP_LEFT;
+	else if (x > VIEW_XMAX) code |= CLIP_RIGHT;
+	if (y < VIEW_YMIN) code |= CLIP_BOTTOM;
+	else if (y > VIEW_YMAX) code |= CLIP_TOP;
+
+	return code;
+}
+
+// Range of Bresenham steps [*first, *last] of a line that stay inside
+// [majmin, majmax] on the major axis and [minmin, minmax] on the minor one.
+// After i steps the minor coordinate has moved n(i) = (i*dy + dx-1-e0)/dx
+// times, so both limits turn into bounds on i and clipping picks exactly
+// the pixels the full loop would have drawn. Returns 0 if none are left.
+int lineClip(int32_t x0, int32_t y0, int32_t dx, int32_t dy, int32_t ystep, int32_t e0,
+		int32_t majmin, int32_t majmax, int32_t minmin, int32_t minmax, int32_t *first, int32_t *last)
+{
+	int32_t a, b, lo, hi, c = dx - 1 - e0;
+
+	lo = (majmin > x0) ? majmin - x0 : 0;
+	hi = (majmax < x0 + dx) ? majmax - x0 : dx;
+
+	// bounds on n(i) from the minor axis
+	if (ystep > 0)
+	{
+		a = minmin - y0;
+		b = minmax - y0;
+	}
+	else
+	{
+		a = y0 - minmax;
+		b = y0 - minmin;
+	}
+
+	if (b < 0)
+
+	 return 0;
+
+	if (dy == 0)
+	{
+		if (a > 0)
+
+		 return 0;
+	}
+	else
+	{
+		// first i with n(i) >= a, last i with n(i) <= b
+		if (a > 0 && (a*dx - c + dy - 1)/dy > lo)
+
+		 lo = (a*dx - c + dy - 1)/dy;
+
+		if (((b + 1)*dx - c - 1)/dy < hi)
+
+		 hi = ((b + 1)*dx - c - 1)/dy;
+	}
+
+	*first = lo;
+	*last = hi;
+
+	return lo <= hi;
+}
+
+void drawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint32_t color)
+
+{
+
+	 uint8_t code0 = clipCode(x0, y0), code1 = clipCode(x1, y1);
+
+	 int32_t first, last, n;
+
+	 // Both ends beyond the same edge, nothing to draw
+	 if (code0 & code1)
+
+	  return;
+
+	 int16_t slope = abs(y1 - y0) > abs(x1 - x0);
+
+	 if (slope) {
+
+	  swap(x0, y0);
+
+	  swap(x1, y1);
+
+	 }
+
+	 if (x0 > x1) {
+
+	  swap(x0, x1);
+
+	  swap(y0, y1);
+
+	 }
+
+	 int16_t dx, dy;
+
+	 dx = x1 - x0;
+
+	 dy = abs(y1 - y0);
+
+	 int16_t err = dx / 2;
+
+	 int16_t ystep;
+
+	 if (y0 < y1) {
+
+	  ystep = 1;
+
+	 }
+
+	 else {
+
+	  ystep = -1;
+
+	 }
+
+	 // A line that leaves the panel starts and ends at its first and last
+	 // visible step, with err and y0 moved to where the loop would have them
+	 if (code0 | code1) {
+
+	  if (slope) {
+
+	   if (!lineClip(x0, y0, dx, dy, ystep, err, VIEW_YMIN, VIEW_YMAX, VIEW_XMIN, VIEW_XMAX, &first, &last))
+
+	    return;
+
+	  }
+
+	  else {
+
+	   if (!lineClip(x0, y0, dx, dy, ystep, err, VIEW_XMIN, VIEW_XMAX, VIEW_YMIN, VIEW_YMAX, &first, &last))
+
+	    return;
+
+	  }
+
+	  n = dy ? (first*dy + dx - 1 - err)/dx : 0;
+
+	  err = err - first*dy + n*dx;
+
+	  y0 += ystep*n;
+
+	  x1 = x0 + last;
+
+	  x0 += first;
+
+	 }
+
+	 int16_t run = x0;
+
+	 // Pixels that share a row (or a column for steep lines) are sent as
+	 // one span instead of one address window per Bresenham step. Every
+	 // step is on the panel now, so the spans go out unchecked.
+	 for (; x0 <= x1; x0++) {
+
+	  err -= dy;
+
+	  if (err < 0 || x0 == x1) {
+
+	   if (slope) {
+
+	    putVSpan(y0, run, x0, color);
+
+	   }
+
+	   else {
+
+	    putHSpan(run, x0, y0, color);
+
+	   }
+
+	   run = x0 + 1;
+
+	  }
+
+	  if (err < 0) {
+
+	   y0 += ystep;
+
+	   err += dx;
+
+	  }
+
+	 }
+
+}
+
+// Declare a structure for 3D
+typedef struct
+{
+	coord x_value; coord y_value; coord z_value;
+}Pts3D;
+
+// Declare a structure for 2D
+typedef struct
+{
+	coord x; coord y;
+}Pts2D;
+
+#if USE_FIXED_POINT
+fixvec3 fixFromPts3D(Pts3D p)
+{
+	return fixvec3_make(p.x_value, p.y_value, p.z_value);
+}
+
+Pts3D fixToPts3D(fixvec3 v)
+{
+	Pts3D p;
+	p.x_value = v.x;
+	p.y_value = v.y;
+	p.z_value = v.z;
+	return p;
+}
+#endif
+
+// Sine and cosine of a fixangle from the lookup table
+void angleSinCos(fixangle a, coord *s, coord *c)
+{
+#if USE_FIXED_POINT
+	fix_sincos(a, s, c);
+#else
+	fix16 fs, fc;
+
+	fix_sincos(a, &fs, &fc);
+	*s = fix_to_float(fs);
+	*c = fix_to_float(fc);
+#endif
+}
+
+// This method is used to calculate the Lambda value in Ray equation calculation
+coord Lambda3D(coord Zi,coord Zs)
+{
+#if USE_FIXED_POINT
+	return fix_div(-Zi, Zs - Zi);
+#else
+	float lambda;
+	lambda = -Zi/(Zs-Zi);
+	return lambda;
+#endif
+}
+
+// This method is used to compute the ray equation for shadow point calculation
+Pts3D ShadowPoint3D(Pts3D Pi, Pts3D Ps, coord lambda)
+{
+	Pts3D pt;
+	pt.x_value = (Pi.x_value + coord_mul(lambda, Ps.x_value-Pi.x_value));
+	pt.y_value = (Pi.y_value + coord_mul(lambda, Ps.y_value-Pi.y_value));
+	pt.z_value = (Pi.z_value + coord_mul(lambda, Ps.z_value-Pi.z_value));
+	return pt;
+}
+
+// This method is used to compute the scaled diffuse reflection term of the light source at point Pi
+// In fixed point cos = dz/|d| and the 1/|d|^2 falloff are taken separately,
+// since |d|^2 only fits in the 64-bit dot product
+coord getDiffuseTerm(Pts3D Pi)
+{
+#if USE_FIXED_POINT
+	fixvec3 d;
+	int64_t dist2;
+	fix16 cosine;
+
+	d = fixvec3_sub(fixvec3_make(Psx, Psy, Psz), fixFromPts3D(Pi));
+	dist2 = fixvec3_dot64(d, d);
+
+	if (dist2 < FIX_ONE)
+
+	 return 0;
+
+	cosine = fix_div(d.z, fix_sqrt64(dist2));
+
+	return fix_saturate(((int64_t)cosine * 16000 * FIX_ONE) / (dist2 >> FIX_SHIFT));
+#else
+	Pts3D Ps;
+	Ps.x_value = Psx;
+	Ps.y_value = Psy;
+	Ps.z_value = Psz;
+	float scaling = 16000;
+
+	//Calculate the diffuse reflection for point Pi
+	float_t temp = ((Ps.z_value - Pi.z_value)/sqrt(pow((Ps.x_value - Pi.x_value),2) + pow((Ps.y_value - Pi.y_value),2) + pow((Ps.z_value - Pi.z_value),2))) / (pow((Ps.x_value - Pi.x_value),2) + pow((Ps.y_value - Pi.y_value),2) + pow((Ps.z_value - Pi.z_value),2));
+
+	//Scale the above result
+	temp *= scaling;
+	return temp;
+#endif
+}
+
+// This method is used to turn a diffuse term into a color with given reflectivity coefficients
+int getDiffuseShade(float temp, float reflectivity_r, float reflectivity_g, float reflectivity_b)
+{
+	uint32_t print_diffuse_color;
+	int diff_red, diff_green, diff_blue;
+	float new_red, new_green, new_blue;
+
+	diff_red = reflectivity_r * temp * 255;
+	diff_green = reflectivity_g * temp * 255;
+	diff_blue  = reflectivity_b * temp * 255;
+
+	//Shift the above values into their spectrum. Eg: shift 16 bits to put value in red spectrum.
+	new_red = (diff_red << 16);
+	new_green = (diff_green << 8);
+	new_blue = (diff_blue);
+	print_diffuse_color = new_red + new_green +new_blue;
+
+	return LCD_COLOR(print_diffuse_color);
+}
+
+// This method is used to compute the diffuse reflection color with given reflectivity coefficients
+int getDiffuseColor(Pts3D Pi, float reflectivity_r, float reflectivity_g, float reflectivity_b)
+{
+	return getDiffuseShade(coord_to_float(getDiffuseTerm(Pi)), reflectivity_r, reflectivity_g, reflectivity_b);
+}
+
+// This method is used to compute the diffuse reflection color with given reflectivity coefficients
+int getDiffuseColorGreen(Pts3D Pi, float reflectivity_r, float reflectivity_g, float reflectivity_b)
+{
+	return getDiffuseColor(Pi, reflectivity_r, reflectivity_g, reflectivity_b);
+}
+
+// Affine transform of coordinates: 3x3 linear part in columns 0-2,
+// translation in column 3
+#if USE_FIXED_POINT
+typedef fixmat34 coordmat;
+#else
+typedef struct
+{
+	float m[3][4];
+}coordmat;
+#endif
+
+// m * p + translation
+Pts3D coordmatApply(const coordmat *m, coord X, coord Y, coord Z)
+{
+#if USE_FIXED_POINT
+	return fixToPts3D(fixmat34_apply(m, fixvec3_make(X, Y, Z)));
+#else
+	Pts3D V;
+
+	V.x_value = m->m[0][0] * X + m->m[0][1] * Y + m->m[0][2] * Z + m->m[0][3];
+	V.y_value = m->m[1][0] * X + m->m[1][1] * Y + m->m[1][2] * Z + m->m[1][3];
+	V.z_value = m->m[2][0] * X + m->m[2][1] * Y + m->m[2][2] * Z + m->m[2][3];
+
+	return V;
+#endif
+}
+
+// The camera caches the world to viewer matrix built from the eye point
+// (Xe, Ye, Ze), so a point costs nine multiply-adds plus the perspective
+// divide instead of the pow/sqrt chain per point. Every transform uses it,
+// get3DTransform included, so the fills line up with the cube edges and the
+// depth buffer gets the Z the screen position was divided by. Change the
+// eye or focal length through cameraSetEye/cameraSetFocal, the matrix is
+// rebuilt on the next transform.
+typedef struct
+{
+	coordmat view;				// world -> viewer
+	coord D;
+	int valid;
+}camera;
+
+camera cam;
+
+// The world to viewer matrix for the eye point, in float
+void cameraMatrix(float m[3][4])
+{
+	float Rho=sqrt(pow(Xe,2)+pow(Ye,2)+pow(Xe,2));
+
+	float sPheta = Ye/sqrt(pow(Xe,2)+pow(Ye,2));
+	float cPheta = Xe/sqrt(pow(Xe,2)+pow(Ye,2));
+	float sPhi = sqrt(pow(Xe,2)+pow(Ye,2))/Rho;
+	float cPhi = Ze/Rho;
+
+	m[0][0] = -sPheta;			m[0][1] = cPheta;			m[0][2] = 0;		m[0][3] = 0;
+	m[1][0] = -cPheta * cPhi;	m[1][1] = -cPhi * sPheta;	m[1][2] = sPhi;		m[1][3] = 0;
+	m[2][0] = -sPhi * cPheta;	m[2][1] = -sPhi * cPheta;	m[2][2] = -cPhi;	m[2][3] = Rho;
+}
+
+// Fill the matrix from the eye point
+void cameraBuild(camera *c)
+{
+	float m[3][4];
+	int i, j;
+
+	cameraMatrix(m);
+
+	for (i = 0; i < 3; i++)
+	 for (j = 0; j < 4; j++)
+	  c->view.m[i][j] = coord_from_float(m[i][j]);
+
+	c->D = coord_from_float(D_focal);
+	c->valid = 1;
+}
+
+// The camera for the current eye point, rebuilt if it was moved
+camera *getCamera()
+{
+	if (!cam.valid)
+
+	 cameraBuild(&cam);
+
+	return &cam;
+}
+
+void cameraSetEye(float X, float Y, float Z)
+{
+	Xe = X; Ye = Y; Ze = Z;
+	cam.valid = 0;
+}
+
+void cameraSetFocal(float D)
+{
+	D_focal = D;
+	cam.valid = 0;
+}
+
+// Depth buffer value of a world point, from the viewer Z get3DTransform
+// divides by. 1/Z is linear in screen space, so these can be interpolated
+// across a polygon; points nearer than ZB_NEAR saturate.
+#define ZB_NEAR 32.0
+
+uint16_t getViewerDepth(Pts3D Pi)
+{
+	const coordmat *m = &getCamera()->view;
+#if USE_FIXED_POINT
+	fix16 z = (fix16)(((int64_t)m->m[2][0] * Pi.x_value + (int64_t)m->m[2][1] * Pi.y_value +
+			(int64_t)m->m[2][2] * Pi.z_value + FIX_HALF) >> FIX_SHIFT) + m->m[2][3];
+
+	if (z <= COORD(ZB_NEAR))
+	 return 65535;
+
+	return ((int64_t)65535 * COORD(ZB_NEAR)) / z;
+#else
+	float z = m->m[2][0] * Pi.x_value + m->m[2][1] * Pi.y_value + m->m[2][2] * Pi.z_value + m->m[2][3];
+
+	if (z <= ZB_NEAR)
+	 return 65535;
+
+	return 65535 * ZB_NEAR / z;
+#endif
+}
+
+// World to Viewer Transform method
+Pts3D getWorld2Viewer(coord WCS_X, coord WCS_Y, coord WCS_Z)
+{
+	return coordmatApply(&getCamera()->view, WCS_X, WCS_Y, WCS_Z);
+}
+
+// Viewer to Perspective Transform method, one divide scales both coordinates
+Pts2D getViewer2Perspective(coord V_X, coord V_Y, coord V_Z)
+{
+	Pts2D P;
+	coord D = getCamera()->D;
+#if USE_FIXED_POINT
+	fix16 k = fix_div(D, V_Z);
+
+	P.x = fix_mul(V_X, k);
+	P.y = fix_mul(V_Y, k);
+#else
+	P.x=V_X*(D/V_Z);
+	P.y=V_Y*(D/V_Z);
+#endif
+	return P;
+}
+
+// World to Viewer to Perspective Transform method
+Pts2D get3DTransform(Pts3D Pi)
+{
+	camera *c = getCamera();
+	Pts3D viewer;
+	Pts2D pt;
+
+	viewer = coordmatApply(&c->view, Pi.x_value, Pi.y_value, Pi.z_value);
+
+#if USE_FIXED_POINT
+	pt.x = fix_muldiv(c->D, viewer.x_value, viewer.z_value);
+	pt.y = fix_muldiv(c->D, viewer.y_value, viewer.z_value);
+#else
+	pt.x=c->D*viewer.x_value/viewer.z_value;
+	pt.y=c->D*viewer.y_value/viewer.z_value;
+#endif
+	return pt;
+}
+
+// Batch world to perspective transform over structure-of-arrays buffers, the
+// same math as getWorld2Viewer followed by getViewer2Perspective. The matrix
+// is loaded once and the loop body has no calls or branches, so the compiler
+// can keep everything in registers (and vectorize it on a host build).
+void transformPoints(const coord *restrict X, const coord *restrict Y, const coord *restrict Z,
+		int n, coord *restrict PX, coord *restrict PY)
+{
+	camera *c = getCamera();
+#if USE_FIXED_POINT
+	const fixmat34 m = c->view;
+	const fix16 D = c->D;
+	fixvec3 V;
+	fix16 k;
+	int i;
+
+	for (i = 0; i < n; i++)
+	{
+		V = fixmat34_apply(&m, fixvec3_make(X[i], Y[i], Z[i]));
+		k = fix_div(D, V.z);
+		PX[i] = fix_mul(V.x, k);
+		PY[i] = fix_mul(V.y, k);
+	}
+#else
+	const float m00 = c->view.m[0][0], m01 = c->view.m[0][1], m02 = c->view.m[0][2], m03 = c->view.m[0][3];
+	const float m10 = c->view.m[1][0], m11 = c->view.m[1][1], m12 = c->view.m[1][2], m13 = c->view.m[1][3];
+	const float m20 = c->view.m[2][0], m21 = c->view.m[2][1], m22 = c->view.m[2][2], m23 = c->view.m[2][3];
+	const float D = c->D;
+	float vx, vy, vz, k;
+	int i;
+
+	for (i = 0; i < n; i++)
+	{
+		vx = m00 * X[i] + m01 * Y[i] + m02 * Z[i] + m03;
+		vy = m10 * X[i] + m11 * Y[i] + m12 * Z[i] + m13;
+		vz = m20 * X[i] + m21 * Y[i] + m22 * Z[i] + m23;
+		k = D / vz;
+		PX[i] = vx * k;
+		PY[i] = vy * k;
+	}
+#endif
+}
+
+// Side of the cube a tree is drawn on
+typedef enum
+{
+	TREE_FRONT,		// the face at x = xstart + cube_side
+	TREE_RIGHT		// the face at y = ystart + cube_side
+}treeface;
+
+/* Rotate point p with respect to o and angle <angle> */
+Pts3D rotate_pointIn3D(Pts3D p, Pts3D o, fixangle angle, treeface face)
+{
+	Pts3D rt, t, new;
+
+	coord s, c;
+
+	angleSinCos(angle, &s, &c);
+
+	/*
+	 * The below commented part is used to project the tree onto front side of the cube
+	 */
+	if(face == TREE_FRONT)
+	{
+		//translate point to origin
+		t.x_value = o.x_value;
+		t.y_value = p.y_value - o.y_value;
+		t.z_value = p.z_value - o.z_value;
+
+		rt.x_value = o.x_value;
+		rt.y_value = coord_mul(t.y_value, c) - coord_mul(t.z_value, s);
+		rt.z_value = coord_mul(t.y_value, s) + coord_mul(t.z_value, c);
+
+		//translate point back
+		new.x_value = o.x_value;
+		new.y_value = rt.y_value + o.y_value;
+		new.z_value = rt.z_value + o.z_value;
+	}
+
+
+	/*
+	 * The below commented part is used to project the tree onto right side of the cube
+	 */
+	if(face == TREE_RIGHT)
+	{
+		//translate point to origin
+		t.x_value = p.x_value - o.x_value;
+		t.y_value = o.y_value;
+		t.z_value = p.z_value - o.z_value;
+
+		rt.x_value = coord_mul(t.x_value, c) - coord_mul(t.z_value, s);
+		rt.y_value = o.y_value;
+		rt.z_value = coord_mul(t.x_value, s) + coord_mul(t.z_value, c);
+
+		//translate point back
+		new.x_value = rt.x_value + o.x_value;
+		new.y_value = o.y_value;
+		new.z_value = rt.z_value + o.z_value;
+	}
+
+	return new;
+}
+
+/* Design the branch of a tree */
+void designTreeTrunkIn3D(Pts3D start3D, Pts3D end3D, uint32_t color, uint8_t thickness)
+{
+	Pts2D lcd, start, end;
+
+	lcd = get3DTransform(start3D);
+
+	start.x = lcd.x;
+	start.y = lcd.y;
+
+	lcd = get3DTransform(end3D);
+
+	end.x = lcd.x;
+	end.y = lcd.y;
+
+	int i;
+	for(i = 0; i < thickness; i++)
+		drawLine(coord_pixel(start.x) + i, coord_pixel(start.y), coord_pixel(end.x) + i, coord_pixel(end.y), color);
+}
+
+#define TREE_MAX_LEVEL 3		// deepest tree designTreeIn3D will generate
+#define TREE_SEGMENTS 39		// branches in a tree that deep, 3 + 9 + 27
+
+// A branch of the tree in world coordinates, drawn from a to b
+typedef struct
+{
+	Pts3D a; Pts3D b;
+}treeseg;
+
+// Project and draw n branches in order. Branches of one node share their
+// end point b, so it is only projected when it changes.
+void drawTreeSegments(const treeseg *seg, int n, uint32_t color)
+{
+	Pts2D a, b;
+	int i;
+
+	for (i = 0; i < n; i++)
+	{
+		if (i == 0 || memcmp(&seg[i].b, &seg[i-1].b, sizeof(Pts3D)) != 0)
+		 b = get3DTransform(seg[i].b);
+
+		a = get3DTransform(seg[i].a);
+		drawLine(coord_pixel(a.x), coord_pixel(a.y), coord_pixel(b.x), coord_pixel(b.y), color);
+	}
+}
+
+/* Design a Tree using drawline method and rotatepoint method */
+// Each node adds its center branch, the two branches rotated 30 degrees
+// either way, and a subtree on each of them. The nodes being worked on sit
+// on an explicit stack with the branch they are up to, which visits them in
+// the same order as recursion would, with at most <level> frames. The
+// branches go to seg, which has room for TREE_SEGMENTS; returns how many.
+int designTreeIn3D(Pts3D start3D, Pts3D end3D, int level, coord lambda, treeface face, treeseg *seg)
+{
+	struct
+	{
+		Pts3D start; Pts3D end; Pts3D c;
+		int level; int branch;
+	}stack[TREE_MAX_LEVEL], *f;
+
+	Pts3D tip;
+	int sp = 0, n = 0;
+
+	if (level > TREE_MAX_LEVEL)
+		level = TREE_MAX_LEVEL;
+
+	if(level <= 0)
+		return 0;
+
+	stack[0].start = start3D;
+	stack[0].end = end3D;
+	stack[0].level = level;
+	stack[0].branch = 0;
+	sp = 1;
+
+	while (sp > 0)
+	{
+		f = &stack[sp - 1];
+
+		switch (f->branch++)
+		{
+		case 0:
+			/*
+			 * The below commented part is used to project the tree onto front side of the cube
+			 */
+			if(face == TREE_FRONT)
+			{
+				f->c.x_value = f->start.x_value;
+				f->c.y_value = f->end.y_value + coord_mul(lambda, f->end.y_value - f->start.y_value);
+				f->c.z_value = f->end.z_value + coord_mul(lambda, f->end.z_value - f->start.z_value);
+			}
+
+			/*
+			 * The below commented part is used to project the tree onto right side of the cube
+			 */
+			if(face == TREE_RIGHT)
+			{
+				f->c.x_value = f->end.x_value + coord_mul(lambda, f->end.x_value - f->start.x_value);
+				f->c.y_value = f->start.y_value;
+				f->c.z_value = f->end.z_value + coord_mul(lambda, f->end.z_value - f->start.z_value);
+			}
+
+			tip = f->c;
+			break;
+
+		case 1:
+			tip = rotate_pointIn3D(f->c, f->end, FIX_ANGLE_DEG(30), face);
+			break;
+
+		case 2:
+			tip = rotate_pointIn3D(f->c, f->end, FIX_ANGLE_DEG(-30), face);
+			break;
+
+		default:
+			sp--;
+			continue;
+		}
+
+		seg[n].a = tip;
+		seg[n].b = f->end;
+		n++;
+
+		// the subtree on the new branch
+		if (f->level > 1)
+		{
+			stack[sp].start = f->end;
+			stack[sp].end = tip;
+			stack[sp].level = f->level - 1;
+			stack[sp].branch = 0;
+			sp++;
+		}
+	}
+
+	return n;
+}
+
+// World space branches of the last tree generated. The tree only depends on
+// its trunk, face, level and lambda, so while those stay the same a frame
+// just projects the cached branches again, whatever the camera does.
+typedef struct
+{
+	Pts3D start; Pts3D end;
+	treeface face; int level; coord lambda;
+	treeseg seg[TREE_SEGMENTS];
+	int n;
+	uint8_t valid;
+}treecache;
+
+static treecache tree_cache;
+
+// This method is used to draw a tree onto a side of the cube
+void drawTree(coord xstart, coord ystart, coord zstart, int cube_side, treeface face)
+{
+	Pts3D start3D, end3D;
+
+	coord lambda = COORD(0.6);
+	int level = 2;
+	treecache *tc = &tree_cache;
+
+	/*
+	 * The below commented part is used to project the tree onto front side of the cube
+	 */
+	if(face == TREE_FRONT)
+	{
+		start3D.x_value = xstart + coord_from_int(cube_side);
+		start3D.y_value = ystart + coord_from_int(cube_side/2);
+		start3D.z_value = zstart;
+
+		end3D.x_value = xstart + coord_from_int(cube_side);
+		end3D.y_value = ystart + coord_from_int(cube_side/2);
+		end3D.z_value = zstart + coord_from_int(cube_side/2);
+	}
+
+	/*
+	 * The below commented part is used to project the tree onto right side of the cube
+	 */
+	if(face == TREE_RIGHT)
+	{
+		start3D.x_value = xstart + coord_from_int(cube_side/2);
+		start3D.y_value = ystart + coord_from_int(cube_side);
+		start3D.z_value = zstart;
 
-	Pts2D pt;
-	pt.x=perspective.X;
-	pt.y=perspective.Y;
-	return pt;
+		end3D.x_value = xstart + coord_from_int(cube_side/2);
+		end3D.y_value = ystart + coord_from_int(cube_side);
+		end3D.z_value = zstart + coord_from_int(cube_side/2);
+	}
+
+	if (!tc->valid || tc->face != face || tc->level != level || tc->lambda != lambda ||
+			memcmp(&tc->start, &start3D, sizeof(Pts3D)) != 0 || memcmp(&tc->end, &end3D, sizeof(Pts3D)) != 0)
+	{
+		tc->start = start3D;
+		tc->end = end3D;
+		tc->face = face;
+		tc->level = level;
+		tc->lambda = lambda;
+		tc->n = designTreeIn3D(start3D, end3D, level, lambda, face, tc->seg);
+		tc->valid = 1;
+	}
 
+	designTreeTrunkIn3D(start3D, end3D, RED, 1);
+	drawTreeSegments(tc->seg, tc->n, RED);
 }
 
-/* Rotate point p with respect to o and angle <angle> */
-Pts3D rotate_pointIn3D(Pts3D p, Pts3D o, float angle, char showOn[])
+// This method is used to rotate the cube with respect to Zw axis alone
+// Note that, this method is written to visualize the arbitrary vector rotation written below
+Pts3D rotate3DZwAxis(int angle, coord cube_x, coord cube_y, coord cube_z)
 {
-	Pts3D rt, t, new;
+	Pts3D final;
+	coord s, c;
 
-	char front[] = "Front";
-	char right[] = "Right";
+	angleSinCos(fix_angle_from_deg(angle), &s, &c);
 
-	float s = sin(angle);
-	float c = cos(angle);
+	final.x_value = coord_mul(cube_x, c) - coord_mul(cube_y, s);
+	final.y_value = coord_mul(cube_y, c) + coord_mul(cube_x, s);
+	final.z_value = cube_z;
 
-	/*
-	 * The below commented part is used to project the tree onto front side of the cube
-	 */
-	if(strcmp(showOn, front) == 0)
+	return final;
+}
+
+//	This method is used to rotate the cube with respect to an arbitrary vector
+// Translating the axis to the origin, turning it onto Zw, rotating about Zw
+// and undoing the turn and the translation collapse into one affine matrix
+// for a given axis and angle. With k the unit axis, c and s the cosine and
+// sine of the angle, Rodrigues' formula gives the linear part
+//	R = c*I + s*[k]x + (1-c)*k*k^T
+// and the translation ARBPi - R*ARBPi keeps the axis in place. Building it
+// once per frame leaves 9 multiplies per vertex.
+void rotationMatrix(Pts3D ARBPi, Pts3D ARBPi1, int angle, coordmat *m)
+{
+#if USE_FIXED_POINT
+	fixvec3 axis, t;
+	fix16 k[3], len, s, c, oc;
+	int i, j;
+
+	axis = fixvec3_sub(fixFromPts3D(ARBPi1), fixFromPts3D(ARBPi));
+	len = fixvec3_length(axis);
+	k[0] = fix_div(axis.x, len);
+	k[1] = fix_div(axis.y, len);
+	k[2] = fix_div(axis.z, len);
+
+	fix_sincos(fix_angle_from_deg(angle), &s, &c);
+	oc = FIX_ONE - c;
+
+	for (i = 0; i < 3; i++)
 	{
-		//translate point to origin
-		t.x_value = o.x_value;
-		t.y_value = p.y_value - o.y_value;
-		t.z_value = p.z_value - o.z_value;
+		for (j = 0; j < 3; j++)
+		 m->m[i][j] = fix_mul(oc, fix_mul(k[i], k[j])) + ((i == j) ? c : 0);
+		m->m[i][3] = 0;
+	}
 
-		rt.x_value = o.x_value;
-		rt.y_value = t.y_value * c - t.z_value * s;
-		rt.z_value = t.y_value * s + t.z_value * c;
+	m->m[0][1] -= fix_mul(s, k[2]); m->m[0][2] += fix_mul(s, k[1]);
+	m->m[1][0] += fix_mul(s, k[2]); m->m[1][2] -= fix_mul(s, k[0]);
+	m->m[2][0] -= fix_mul(s, k[1]); m->m[2][1] += fix_mul(s, k[0]);
+
+	t = fixvec3_sub(fixFromPts3D(ARBPi), fixmat34_apply(m, fixFromPts3D(ARBPi)));
+	m->m[0][3] = t.x; m->m[1][3] = t.y; m->m[2][3] = t.z;
+#else
+	float k[3], len, s, c, oc;
+	int i, j;
+
+	k[0] = ARBPi1.x_value - ARBPi.x_value;
+	k[1] = ARBPi1.y_value - ARBPi.y_value;
+	k[2] = ARBPi1.z_value - ARBPi.z_value;
+	len = sqrt(k[0]*k[0] + k[1]*k[1] + k[2]*k[2]);
+	k[0] /= len; k[1] /= len; k[2] /= len;
+
+	angleSinCos(fix_angle_from_deg(angle), &s, &c);
+	oc = 1 - c;
+
+	for (i = 0; i < 3; i++)
+	 for (j = 0; j < 3; j++)
+	  m->m[i][j] = oc*k[i]*k[j] + ((i == j) ? c : 0);
+
+	m->m[0][1] -= s*k[2]; m->m[0][2] += s*k[1];
+	m->m[1][0] += s*k[2]; m->m[1][2] -= s*k[0];
+	m->m[2][0] -= s*k[1]; m->m[2][1] += s*k[0];
+
+	m->m[0][3] = ARBPi.x_value - (m->m[0][0]*ARBPi.x_value + m->m[0][1]*ARBPi.y_value + m->m[0][2]*ARBPi.z_value);
+	m->m[1][3] = ARBPi.y_value - (m->m[1][0]*ARBPi.x_value + m->m[1][1]*ARBPi.y_value + m->m[1][2]*ARBPi.z_value);
+	m->m[2][3] = ARBPi.z_value - (m->m[2][0]*ARBPi.x_value + m->m[2][1]*ARBPi.y_value + m->m[2][2]*ARBPi.z_value);
+#endif
+}
 
-		//translate point back
-		new.x_value = o.x_value;
-		new.y_value = rt.y_value + o.y_value;
-		new.z_value = rt.z_value + o.z_value;
+// Rotate n vertices held as structure-of-arrays in place by <angle> degrees
+// about the axis ARBPi -> ARBPi1. The matrix is built once for all of them.
+void rotateCoord3D(Pts3D ARBPi, Pts3D ARBPi1, int angle, coord *restrict X, coord *restrict Y, coord *restrict Z, int n)
+{
+	coordmat m;
+	Pts3D v;
+	int i;
+
+	rotationMatrix(ARBPi, ARBPi1, angle, &m);
+
+	for (i = 0; i < n; i++)
+	{
+		v = coordmatApply(&m, X[i], Y[i], Z[i]);
+		X[i] = v.x_value; Y[i] = v.y_value; Z[i] = v.z_value;
 	}
+}
+
+#define POLY_MAX_VERTS 8
+
+// Scanline fill of a polygon given in virtual coordinates. Rows are sampled
+// at integer y with half-open edges and spans run from ceil(xa) to
+// ceil(xb)-1, so polygons sharing an edge never touch the same pixel twice.
+// The even-odd rule pairs up the crossings, which covers concave outlines.
+// With shade set, the diffuse term is interpolated along the edges and the
+// spans (Gouraud) and turned into a color with the given reflectivity;
+// otherwise the polygon is filled with the flat color. With depth set, the
+// per-vertex depth is interpolated the same way and every pixel is depth
+// tested before it is shaded.
+void scanPolygon(const Pts2D *v, const float *shade, const float *depth, int n, uint32_t color,
+		float reflectivity_r, float reflectivity_g, float reflectivity_b)
+{
+	float vx[POLY_MAX_VERTS], vy[POLY_MAX_VERTS];
+	float xs[POLY_MAX_VERTS], ss[POLY_MAX_VERTS], zs[POLY_MAX_VERTS];
+	float ymin, ymax, t, x, s, ds, z, dz;
+	int16_t y, ytop, ybot, xa, xb, px, run;
+	int i, j, k, cnt, visible, open;
+	uint32_t c, runcolor;
 
+	if ((n < 3) || (n > POLY_MAX_VERTS))
 
-	/*
-	 * The below commented part is used to project the tree onto right side of the cube
-	 */
-	if(strcmp(showOn, right) == 0)
+	 return;
+
+	// The vertices leave the coordinate pipeline here
+	for (i = 0; i < n; i++)
 	{
-		//translate point to origin
-		t.x_value = p.x_value - o.x_value;
-		t.y_value = o.y_value;
-		t.z_value = p.z_value - o.z_value;
+		vx[i] = coord_to_float(v[i].x);
+		vy[i] = coord_to_float(v[i].y);
+	}
 
-		rt.x_value = t.x_value * c - t.z_value * s;
-		rt.y_value = o.y_value;
-		rt.z_value = t.x_value * s + t.z_value * c;
+	ymin = ymax = vy[0];
 
-		//translate point back
-		new.x_value = rt.x_value + o.x_value;
-		new.y_value = o.y_value;
-		new.z_value = rt.z_value + o.z_value;
+	for (i = 1; i < n; i++)
+	{
+		if (vy[i] < ymin) ymin = vy[i];
+		if (vy[i] > ymax) ymax = vy[i];
 	}
 
-	return new;
+	// Only the rows that land on the panel
+	ybot = ceilf(ymin);
+	ytop = floorf(ymax);
+
+	if (ybot < (_height>>1) - (_height - 1))
+
+	 ybot = (_height>>1) - (_height - 1);
+
+	if (ytop > (_height>>1))
+
+	 ytop = _height>>1;
+
+	for (y = ybot; y <= ytop; y++)
+	{
+		// Crossings of every edge with this row, kept sorted by x
+		cnt = 0;
+
+		for (i = 0, j = n - 1; i < n; j = i++)
+		{
+			if ((vy[i] <= y) == (vy[j] <= y))
+
+			 continue;
+
+			t = (y - vy[j]) / (vy[i] - vy[j]);
+			x = vx[j] + t * (vx[i] - vx[j]);
+			s = shade ? shade[j] + t * (shade[i] - shade[j]) : 0;
+			z = depth ? depth[j] + t * (depth[i] - depth[j]) : 0;
+
+			for (k = cnt; (k > 0) && (xs[k-1] > x); k--)
+			{
+				xs[k] = xs[k-1];
+				ss[k] = ss[k-1];
+				zs[k] = zs[k-1];
+			}
+			xs[k] = x;
+			ss[k] = s;
+			zs[k] = z;
+			cnt++;
+		}
+
+		for (k = 0; k + 1 < cnt; k += 2)
+		{
+			xa = ceilf(xs[k]);
+			xb = ceilf(xs[k+1]) - 1;
+
+			if (xa > xb)
+
+			 continue;
+
+			if (!shade && !depth)
+			{
+				drawHSpan(xa, xb, y, color);
+				continue;
+			}
+
+			// Walk the span and emit one run per color change, hidden
+			// pixels end the run and are neither shaded nor drawn
+			ds = (ss[k+1] - ss[k]) / (xs[k+1] - xs[k]);
+			s = ss[k] + (xa - xs[k]) * ds;
+			dz = (zs[k+1] - zs[k]) / (xs[k+1] - xs[k]);
+			z = zs[k] + (xa - xs[k]) * dz;
+			c = runcolor = color;
+			run = xa;
+			open = 0;
+
+			for (px = xa; px <= xb; px++, s += ds, z += dz)
+			{
+				visible = 1;
+#if USE_DEPTH_BUFFER
+				if (depth)
+				 visible = zb_test(xConvertToPhysical(px), yConvertToPhysical(y), z);
+#endif
+				if (visible && shade)
+				 c = getDiffuseShade(s, reflectivity_r, reflectivity_g, reflectivity_b);
+
+				if (open && (!visible || (c != runcolor)))
+				{
+					drawHSpan(run, px - 1, y, runcolor);
+					open = 0;
+				}
+
+				if (visible && !open)
+				{
+					runcolor = c;
+					run = px;
+					open = 1;
+				}
+			}
+
+			if (open)
+			 drawHSpan(run, xb, y, runcolor);
+		}
+	}
 }
 
-// This method is used to draw a tree onto a side of the cube
-void drawTree(float xstart, float ystart, float zstart, int cube_side, char showOn[])
+// Fill a polygon in virtual coordinates with a single color
+void fillPolygon(const Pts2D *v, int n, uint32_t color)
 {
-	Pts3D start3D, end3D;
+	scanPolygon(v, 0, 0, n, color, 0, 0, 0);
+}
 
-	double lambda = 0.6;
-	char front[] = "Front";
-	char right[] = "Right";
+// Fill a world-space polygon: the vertices are projected once and the
+// polygon is filled either flat or with the diffuse term of each vertex
+// interpolated across it
+void fillPolygon3D(const Pts3D *w, int n, uint32_t color, int diffuse,
+		float reflectivity_r, float reflectivity_g, float reflectivity_b)
+{
+	Pts2D v[POLY_MAX_VERTS];
+	float shade[POLY_MAX_VERTS], depth[POLY_MAX_VERTS];
+	int i;
 
-	/*
-	 * The below commented part is used to project the tree onto front side of the cube
-	 */
-	if(strcmp(showOn, front) == 0)
+	if (n > POLY_MAX_VERTS)
+
+	 return;
+
+	for (i = 0; i < n; i++)
 	{
-		start3D.x_value = xstart + cube_side;
-		start3D.y_value = ystart + (cube_side/2);
-		start3D.z_value = zstart;
+		v[i] = get3DTransform(w[i]);
+		shade[i] = diffuse ? coord_to_float(getDiffuseTerm(w[i])) : 0;
+		depth[i] = getViewerDepth(w[i]);
+	}
+
+#if USE_DEPTH_BUFFER
+	scanPolygon(v, diffuse ? shade : 0, depth, n, color, reflectivity_r, reflectivity_g, reflectivity_b);
+#else
+	scanPolygon(v, diffuse ? shade : 0, 0, n, color, reflectivity_r, reflectivity_g, reflectivity_b);
+#endif
+}
+
+#define MESH_MAX_VERTS 16
+#define MESH_FACE_VERTS 4
+
+// A face of a mesh: indices into the mesh vertices, counter-clockwise when
+// seen from outside. Diffuse faces are Gouraud shaded with the given
+// reflectivity, the others are filled with color.
+typedef struct
+{
+	uint8_t n; uint8_t v[MESH_FACE_VERTS];
+	uint32_t color;
+	uint8_t diffuse;
+	float reflectivity_r; float reflectivity_g; float reflectivity_b;
+}meshface;
+
+// A closed mesh with its vertices in world coordinates
+typedef struct
+{
+	const coord *X; const coord *Y; const coord *Z;
+	uint8_t verts;
+	const meshface *face;
+	uint8_t faces;
+}mesh;
+
+// Draw the faces of a mesh that can be seen. Every vertex is projected
+// once. The whole mesh is dropped when its screen box misses the panel or
+// a vertex is too near the eye to project. A face is dropped when it
+// winds clockwise on screen (it faces away from the eye) or its own box
+// misses the panel, so only visible faces are shaded and rasterized.
+void drawMesh(const mesh *m)
+{
+	Pts2D p[MESH_MAX_VERTS], v[MESH_FACE_VERTS];
+	float depth[MESH_MAX_VERTS], fdepth[MESH_FACE_VERTS], shade[MESH_FACE_VERTS];
+	coord xmin, xmax, ymin, ymax;
+	coordwide area;
+	const meshface *f;
+	Pts3D w;
+	int i, j, k;
+
+	if (m->verts > MESH_MAX_VERTS)
+
+	 return;
+
+	for (i = 0; i < m->verts; i++)
+	{
+		w.x_value = m->X[i]; w.y_value = m->Y[i]; w.z_value = m->Z[i];
+		p[i] = get3DTransform(w);
+		depth[i] = getViewerDepth(w);
+
+		// Behind or right at the eye, the projection is meaningless
+		if (depth[i] >= 65535)
+
+		 return;
+
+		if (i == 0 || p[i].x < xmin) xmin = p[i].x;
+		if (i == 0 || p[i].x > xmax) xmax = p[i].x;
+		if (i == 0 || p[i].y < ymin) ymin = p[i].y;
+		if (i == 0 || p[i].y > ymax) ymax = p[i].y;
+	}
+
+	// View volume: the mesh is off the panel
+	if ((xmax < coord_from_int(VIEW_XMIN)) || (xmin > coord_from_int(VIEW_XMAX)) ||
+			(ymax < coord_from_int(VIEW_YMIN)) || (ymin > coord_from_int(VIEW_YMAX)))
+
+	 return;
+
+	for (k = 0, f = m->face; k < m->faces; k++, f++)
+	{
+		if (f->n < 3 || f->n > MESH_FACE_VERTS)
+
+		 continue;
+
+		// Back face: twice the signed area of the projected outline
+		area = 0;
+		for (i = 0, j = f->n - 1; i < f->n; j = i++)
+		 area += coord_wide_mul(p[f->v[j]].x - p[f->v[i]].x, p[f->v[j]].y + p[f->v[i]].y);
+
+		if (area <= 0)
+
+		 continue;
+
+		xmin = xmax = p[f->v[0]].x;
+		ymin = ymax = p[f->v[0]].y;
+
+		for (i = 0; i < f->n; i++)
+		{
+			v[i] = p[f->v[i]];
+			fdepth[i] = depth[f->v[i]];
+
+			if (v[i].x < xmin) xmin = v[i].x;
+			if (v[i].x > xmax) xmax = v[i].x;
+			if (v[i].y < ymin) ymin = v[i].y;
+			if (v[i].y > ymax) ymax = v[i].y;
+		}
+
+		if ((xmax < coord_from_int(VIEW_XMIN)) || (xmin > coord_from_int(VIEW_XMAX)) ||
+				(ymax < coord_from_int(VIEW_YMIN)) || (ymin > coord_from_int(VIEW_YMAX)))
+
+		 continue;
+
+		if (f->diffuse)
+		{
+			for (i = 0; i < f->n; i++)
+			{
+				w.x_value = m->X[f->v[i]]; w.y_value = m->Y[f->v[i]]; w.z_value = m->Z[f->v[i]];
+				shade[i] = coord_to_float(getDiffuseTerm(w));
+			}
+		}
+
+#if USE_DEPTH_BUFFER
+		scanPolygon(v, f->diffuse ? shade : 0, fdepth, f->n, f->color,
+				f->reflectivity_r, f->reflectivity_g, f->reflectivity_b);
+#else
+		scanPolygon(v, f->diffuse ? shade : 0, 0, f->n, f->color,
+				f->reflectivity_r, f->reflectivity_g, f->reflectivity_b);
+#endif
+	}
+}
+
+// Faces of the cube, indexed like its corners in drawCube(): corner i sits
+// at the low (0) or high (1) end of the unrotated cube's z, y and x given by
+// bits 0, 1 and 2 of i. Top is the red diffuse side, the +x side is orange
+// and the +y side purple like the hand-picked fills were, the opposite sides
+// repeat their colors.
+const meshface box_faces[6] = {
+	{ 4, {1, 5, 7, 3}, 0, 1, 0.8, 0.0, 0.0 },					// top
+	{ 4, {4, 6, 7, 5}, LCD_COLOR(0xf59105), 0, 0, 0, 0 },		// +x, front
+	{ 4, {2, 3, 7, 6}, LCD_COLOR(0x5905f5), 0, 0, 0, 0 },		// +y, right
+	{ 4, {0, 1, 3, 2}, LCD_COLOR(0xf59105), 0, 0, 0, 0 },		// -x
+	{ 4, {0, 4, 5, 1}, LCD_COLOR(0x5905f5), 0, 0, 0, 0 },		// -y
+	{ 4, {0, 2, 6, 4}, 0, 1, 0.8, 0.0, 0.0 },					// bottom
+};
+
+// Screen boxes of what drawCube() draws
+typedef enum
+{
+	FOOT_CUBE, FOOT_SHADOW, FOOTPRINTS
+}footprint;
+
+// method to draw the cube
+// Draw the cube turned by <angle> degrees with its shadow and tree. <foot> is
+// grown by the screen box each of them covers.
+void drawCube(int angle, scrbox *foot)
+{
+	#define UpperBD 52
+	#define NumOfPts 16
+
+	typedef struct
+	{
+		coord X[UpperBD]; coord Y[UpperBD]; coord Z[UpperBD];
+	}pworld;
+
+	// Perspective coordinates, and the pixels drawLine takes for them
+	typedef struct
+	{
+		coord X[UpperBD]; coord Y[UpperBD];
+		int16_t SX[UpperBD]; int16_t SY[UpperBD];
+	}pperspective;
+
+	pworld WCS;
+	pperspective P;
+	Pts3D ARBPi, ARBPi1;
+	coord L1,L2,L3,L4;
+	int i;
+
+	// Points 0 to 3 are the origin and the axes, drawn with the background
+
+	// New points to define the cube center as (80,80,35)
+	WCS.X[4]=COORD(55.0); WCS.Y[4]=COORD(55.0); WCS.Z[4]=COORD(10.0);
+	WCS.X[5]=COORD(55.0); WCS.Y[5]=COORD(55.0); WCS.Z[5]=COORD(60.0);
+	WCS.X[6]=COORD(55.0); WCS.Y[6]=COORD(105.0); WCS.Z[6]=COORD(10.0);
+	WCS.X[7]=COORD(55.0); WCS.Y[7]=COORD(105.0); WCS.Z[7]=COORD(60.0);
+	WCS.X[8]=COORD(105.0); WCS.Y[8]=COORD(55.0); WCS.Z[8]=COORD(10.0);
+	WCS.X[9]=COORD(105.0); WCS.Y[9]=COORD(55.0); WCS.Z[9]=COORD(60.0);
+	WCS.X[10]=COORD(105.0); WCS.Y[10]=COORD(105.0); WCS.Z[10]=COORD(10.0);
+	WCS.X[11]=COORD(105.0); WCS.Y[11]=COORD(105.0); WCS.Z[11]=COORD(60.0);
+
+	//Define given Arbitrary vectors
+	ARBPi.x_value=COORD(0.0); ARBPi.y_value=COORD(0.0); ARBPi.z_value=COORD(35.0);
+	ARBPi1.x_value=COORD(200.0); ARBPi1.y_value=COORD(220.0); ARBPi1.z_value=COORD(40.0);
+
+	//Rotate the eight vertices of the cube (4 to 11) and get new coordinates
+	rotateCoord3D(ARBPi, ARBPi1, angle, &WCS.X[4], &WCS.Y[4], &WCS.Z[4], 8);
+
+	//Shadow Calculation
+
+	// Point of Light Source PS(-20, -20, 220)
+	WCS.X[12]=Psx; WCS.Y[12]=Psy; WCS.Z[12]=Psz;
+
+	Pts3D Ps;
+	Ps.x_value = WCS.X[12]; Ps.y_value = WCS.Y[12]; Ps.z_value = WCS.Z[12];
+
+	Pts3D P1;
+	P1.x_value = WCS.X[5]; P1.y_value = WCS.Y[5]; P1.z_value = WCS.Z[5];
+
+	Pts3D P2;
+	P2.x_value = WCS.X[9]; P2.y_value = WCS.Y[9]; P2.z_value = WCS.Z[9];
+
+	Pts3D P3;
+	P3.x_value = WCS.X[11]; P3.y_value = WCS.Y[11]; P3.z_value = WCS.Z[11];
+
+	Pts3D P4;
+	P4.x_value = WCS.X[7]; P4.y_value = WCS.Y[7]; P4.z_value = WCS.Z[7];
+
+	// Shadow Points
+
+	Pts3D S1,S2,S3,S4;
+	L1 = Lambda3D(WCS.Z[5],WCS.Z[12]);
+	L2 = Lambda3D(WCS.Z[9],WCS.Z[12]);
+	L3 = Lambda3D(WCS.Z[11],WCS.Z[12]);
+	L4 = Lambda3D(WCS.Z[7],WCS.Z[12]);
+	S1 = ShadowPoint3D(P1,Ps,L1);
+	S2 = ShadowPoint3D(P2,Ps,L2);
+	S3 = ShadowPoint3D(P3,Ps,L3);
+	S4 = ShadowPoint3D(P4,Ps,L4);
+
+	WCS.X[13]=S1.x_value;		WCS.Y[13]=S1.y_value;		WCS.Z[13]=S1.z_value; //S1
+	WCS.X[14]=S2.x_value;		WCS.Y[14]=S2.y_value;		WCS.Z[14]=S2.z_value; //S2
+	WCS.X[15]=S3.x_value;		WCS.Y[15]=S3.y_value;		WCS.Z[15]=S3.z_value; //S3
+	WCS.X[16]=S4.x_value;		WCS.Y[16]=S4.y_value;		WCS.Z[16]=S4.z_value; //S4
+
+	// World to Viewer to perspective transform for all the points
+	transformPoints(&WCS.X[4], &WCS.Y[4], &WCS.Z[4], NumOfPts-3, &P.X[4], &P.Y[4]);
+
+	for (i = 4; i <= NumOfPts; i++)
+	{
+		P.SX[i] = coord_pixel(P.X[i]);
+		P.SY[i] = coord_pixel(P.Y[i]);
+	}
+
+	Pts3D temp_pt;
+
+	temp_pt.x_value = WCS.X[5]; temp_pt.y_value = WCS.Y[5]; temp_pt.z_value = WCS.Z[5];
+
+	float temp_color;
+
+	temp_color = getDiffuseColor(temp_pt, 0.8, 0.0, 0.0);
+
+	// Draw Lines for all the edges of the cube
+	dl_track(&foot[FOOT_CUBE]);
+
+	//New Centered Cube DrawLines
+	drawLine(P.SX[6],P.SY[6],P.SX[4],P.SY[4],WHITE);
+	drawLine(P.SX[10],P.SY[10],P.SX[8],P.SY[8],WHITE);
+	drawLine(P.SX[6],P.SY[6],P.SX[10],P.SY[10],BLUE);
+	drawLine(P.SX[8],P.SY[8],P.SX[4],P.SY[4],WHITE);
+
+	drawLine(P.SX[7],P.SY[7],P.SX[5],P.SY[5],temp_color);
+	drawLine(P.SX[7],P.SY[7],P.SX[11],P.SY[11],WHITE);
+	drawLine(P.SX[9],P.SY[9],P.SX[11],P.SY[11],WHITE);
+	drawLine(P.SX[9],P.SY[9],P.SX[5],P.SY[5],temp_color);
+
+	drawLine(P.SX[9],P.SY[9],P.SX[8],P.SY[8],temp_color);
+	drawLine(P.SX[11],P.SY[11],P.SX[10],P.SY[10],WHITE);
+	drawLine(P.SX[5],P.SY[5],P.SX[4],P.SY[4],temp_color);
+	drawLine(P.SX[7],P.SY[7],P.SX[6],P.SY[6],BLUE);
+
+	// Shadow Drawlines
+	dl_track(&foot[FOOT_SHADOW]);
+
+	drawLine(P.SX[13],P.SY[13],P.SX[14],P.SY[14],DARKBLUE);
+	drawLine(P.SX[14],P.SY[14],P.SX[15],P.SY[15],DARKBLUE);
+	drawLine(P.SX[16],P.SY[16],P.SX[15],P.SY[15],DARKBLUE);
+	drawLine(P.SX[16],P.SY[16],P.SX[13],P.SY[13],DARKBLUE);
+
+	// The shadow is the quad S1,S2,S3,S4 on the ground plane, the same loop
+	// the outline above traces; once the cube turns it is no longer a
+	// rectangle in x and y
+	Pts3D shadow[4] = {S1, S2, S3, S4};
+
+#if !USE_DEPTH_BUFFER
+	//Shadow fill
+	dl_track(&foot[FOOT_SHADOW]);
+	fillPolygon3D(shadow, 4, DARKBLUE, 0, 0, 0, 0);
+#endif
+
+	// The faces span the eight rotated corners, the mesh path picks the ones
+	// that face the eye
+	mesh box;
+
+	box.X = &WCS.X[4]; box.Y = &WCS.Y[4]; box.Z = &WCS.Z[4]; box.verts = 8;
+	box.face = box_faces; box.faces = 6;
+	dl_track(&foot[FOOT_CUBE]);
+	drawMesh(&box);
+
+#if USE_DEPTH_BUFFER
+	//Shadow fill, last so the parts the cube and the sphere hide fail the
+	//depth test
+	dl_track(&foot[FOOT_SHADOW]);
+	zb_write = 0;
+	fillPolygon3D(shadow, 4, DARKBLUE, 0, 0, 0, 0);
+	zb_write = 1;
+#endif
+
+	//Draw Tree on the given visible side
+	int cube_side = 50;
+	dl_track(&foot[FOOT_CUBE]);
+	drawTree(WCS.X[4], WCS.Y[4], WCS.Z[4], cube_side, TREE_RIGHT);
+
+	dl_track(0);
+}
+
+/*****************************************************************************
+
+** Ellipses
+
+** A circle parallel to the ground projects to an ellipse. When the eye looks
+** at the circle's axis, the ellipse is symmetric about a vertical screen line
+** and its axes line up with the panel, so it can be drawn with the integer
+** midpoint algorithm from a center and two semi-axes. projectCircle() fits
+** that ellipse from four projected points and checks the fit on four more;
+** strong perspective or an off-axis circle fails the check and the caller
+** falls back to sampling points.
+
+*****************************************************************************/
+
+#define ELLIPSE_MAX_AXIS 255		// keeps the decision variables in range
+#define ELLIPSE_FIT_TOL 0.75		// pixels
+#define ELLIPSE_SHADES 32			// colors around a shaded outline, multiple of 4
+
+typedef struct
+{
+	int16_t x0; int16_t y0;			// center, virtual coordinates
+	int16_t a; int16_t b;			// semi-axes along x and y, in pixels
+	int8_t sx; int8_t sy;			// screen sign of the circle's side and eye directions
+}ellipse;
+
+// Fit the projection of the circle of radius r around (cx,cy) at height cz.
+// Returns 0 when it is not an axis-aligned ellipse within ELLIPSE_FIT_TOL.
+int projectCircle(coord cx, coord cy, coord cz, coord r, ellipse *e)
+{
+	coord X[8], Y[8], Z[8], QX[8], QY[8];
+	coord ux, uy, rd;
+	float PX[8], PY[8];
+	float x0, y0, a, b, t, dx, dy;
+	int i;
+
+	// eye direction on the ground (u) and the side direction (w = u turned 90)
+	t = sqrt(Xe*Xe + Ye*Ye);
+	if (t < 1)
+
+	 return 0;
+
+	ux = coord_from_float(Xe/t); uy = coord_from_float(Ye/t);
+	rd = coord_mul(r, COORD(0.70710678));
+
+	// near, far, side and side, then the four diagonals to check the fit
+	X[0] = cx + coord_mul(r, ux);			Y[0] = cy + coord_mul(r, uy);
+	X[1] = cx - coord_mul(r, ux);			Y[1] = cy - coord_mul(r, uy);
+	X[2] = cx - coord_mul(r, uy);			Y[2] = cy + coord_mul(r, ux);
+	X[3] = cx + coord_mul(r, uy);			Y[3] = cy - coord_mul(r, ux);
+	X[4] = cx + coord_mul(rd, ux - uy);		Y[4] = cy + coord_mul(rd, uy + ux);
+	X[5] = cx + coord_mul(rd, ux + uy);		Y[5] = cy + coord_mul(rd, uy - ux);
+	X[6] = cx - coord_mul(rd, ux + uy);		Y[6] = cy - coord_mul(rd, uy - ux);
+	X[7] = cx - coord_mul(rd, ux - uy);		Y[7] = cy - coord_mul(rd, uy + ux);
+
+	for (i = 0; i < 8; i++)
+	{
+		Z[i] = cz;
+
+		// the whole circle has to be in front of the eye
+		if (getWorld2Viewer(X[i], Y[i], Z[i]).z_value < COORD(ZB_NEAR))
 
-		end3D.x_value = xstart + cube_side;
-		end3D.y_value = ystart + (cube_side/2);
-		end3D.z_value = zstart + (cube_side/2);
+		 return 0;
 	}
 
-	/*
-	 * The below commented part is used to project the tree onto right side of the cube
-	 */
-	if(strcmp(showOn, right) == 0)
-	{
-		start3D.x_value = xstart + (cube_side/2);
-		start3D.y_value = ystart + cube_side;
-		start3D.z_value = zstart;
+	transformPoints(X, Y, Z, 8, QX, QY);
 
-		end3D.x_value = xstart + (cube_side/2);
-		end3D.y_value = ystart + cube_side;
-		end3D.z_value = zstart + (cube_side/2);
+	// the fit is done on the screen in float, it only leaves integers
+	for (i = 0; i < 8; i++)
+	{
+		PX[i] = coord_to_float(QX[i]);
+		PY[i] = coord_to_float(QY[i]);
 	}
 
-	designTreeTrunkIn3D(start3D, end3D, RED, 1, showOn);
-	designTreeIn3D(start3D, end3D, 2, lambda, showOn);
-}
+	// near and far points sit on the symmetry line, at the ends of the y axis
+	if (fabsf(PX[0] - PX[1]) > ELLIPSE_FIT_TOL)
 
-/* Design the branch of a tree */
-void designTreeTrunkIn3D(Pts3D start3D, Pts3D end3D, uint32_t color, uint8_t thickness, char showOn[])
-{
-	Pts2D lcd, start, end;
+	 return 0;
 
-	lcd = get3DTransform(start3D);
+	x0 = (PX[0] + PX[1]) / 2;
+	y0 = (PY[0] + PY[1]) / 2;
+	b = fabsf(PY[0] - PY[1]) / 2;
 
-	start.x = lcd.x;
-	start.y = lcd.y;
+	if (b < 1)
 
-	lcd = get3DTransform(end3D);
+	 return 0;
 
-	end.x = lcd.x;
-	end.y = lcd.y;
+	t = (PY[2] - y0) / b;
+	if (t*t >= 0.95)
 
-	int i;
-	for(i = 0; i < thickness; i++)
-		drawLine(start.x + i, start.y, end.x + i, end.y, color);
-}
+	 return 0;
 
-/* Design a Tree using drawline method and rotatepoint method */
-void designTreeIn3D(Pts3D start3D, Pts3D end3D, int level, double lambda, char showOn[])
-{
-	Pts2D lcd, c, start, end;
-	Pts3D c3D, rtl3D, rtr3D;
+	a = fabsf(PX[2] - x0) / sqrt(1 - t*t);
 
-	char front[] = "Front";
-	char right[] = "Right";
+	if (a < 1 || a > ELLIPSE_MAX_AXIS || b > ELLIPSE_MAX_AXIS)
 
-	if(level == 0)
-		return;
+	 return 0;
 
-	lcd = get3DTransform(start3D);
+	// every other point has to land on that ellipse
+	for (i = 2; i < 8; i++)
+	{
+		dx = (PX[i] - x0) / a;
+		dy = (PY[i] - y0) / b;
+		t = sqrt(dx*dx + dy*dy);
 
-	start.x = lcd.x;
-	start.y = lcd.y;
+		if (fabsf(t - 1) * ((a > b) ? a : b) > ELLIPSE_FIT_TOL)
 
-	lcd = get3DTransform(end3D);
+		 return 0;
+	}
 
-	end.x = lcd.x;
-	end.y = lcd.y;
+	e->x0 = floorf(x0 + 0.5);
+	e->y0 = floorf(y0 + 0.5);
+	e->a = floorf(a + 0.5);
+	e->b = floorf(b + 0.5);
+	e->sx = (PX[2] > x0) ? 1 : -1;
+	e->sy = (PY[0] > y0) ? 1 : -1;
 
-	/*
-	 * The below commented part is used to project the tree onto front side of the cube
-	 */
-	if(strcmp(showOn, front) == 0)
-	{
-		c3D.x_value = start3D.x_value;
-		c3D.y_value = end3D.y_value + (lambda*(end3D.y_value - start3D.y_value));
-		c3D.z_value = end3D.z_value + (lambda*(end3D.z_value - start3D.z_value));
-	}
+	return 1;
+}
 
-	/*
-	 * The below commented part is used to project the tree onto right side of the cube
-	 */
-	if(strcmp(showOn, right) == 0)
-	{
-		c3D.x_value = end3D.x_value + (lambda*(end3D.x_value - start3D.x_value));
-		c3D.y_value = start3D.y_value;
-		c3D.z_value = end3D.z_value + (lambda*(end3D.z_value - start3D.z_value));
-	}
+// Diffuse colors and depths around a projected circle. Entry k covers
+// ellipse angles (k, k+1) * 360/ELLIPSE_SHADES counter-clockwise from +x.
+// The ellipse angle is taken as the circle angle measured from the side
+// direction, which is exact at the four vertices and close in between.
+void ellipseShades(const ellipse *e, coord cx, coord cy, coord cz, coord r,
+		float reflectivity_r, float reflectivity_g, float reflectivity_b, lcdcolor *shade, uint16_t *depth)
+{
+	coord ux, uy, c, s;
+	float t;
+	Pts3D pt;
+	int i;
 
-	lcd = get3DTransform(c3D);
+	t = sqrt(Xe*Xe + Ye*Ye);
+	ux = coord_from_float(Xe/t); uy = coord_from_float(Ye/t);
 
-	c.x = lcd.x;
-	c.y = lcd.y;
+	for (i = 0; i < ELLIPSE_SHADES; i++)
+	{
+		angleSinCos((2*i + 1) * (65536 / 2 / ELLIPSE_SHADES), &s, &c);
+		c = coord_mul(c * e->sx, r);
+		s = coord_mul(s * e->sy, r);
+
+		// c along the side direction w = (-uy, ux), s along the eye direction u
+		pt.x_value = cx - coord_mul(c, uy) + coord_mul(s, ux);
+		pt.y_value = cy + coord_mul(c, ux) + coord_mul(s, uy);
+		pt.z_value = cz;
 
-	drawLine(c.x, c.y, end.x, end.y, RED);
-	designTreeIn3D(end3D, c3D, level - 1, lambda, showOn);
+		shade[i] = getDiffuseColor(pt, reflectivity_r, reflectivity_g, reflectivity_b);
+		depth[i] = getViewerDepth(pt);
+	}
+}
 
-	rtl3D = rotate_pointIn3D(c3D, end3D, pi/6, showOn);
+// Run of outline pixels in the first quadrant, a row (ya == yb) or a column
+typedef struct
+{
+	int16_t xa; int16_t xb; int16_t ya; int16_t yb;
+	int q;							// shade sector, -1 while the run is empty
+}ellipserun;
+
+// Draw the run at (xa..xb, ya..yb) relative to the center in the color of
+// sector k, and with its depth in zb_ink when there is a <depth>, mirrored
+// by sx and sy. The mirrors leave out the pixels on the axes, which the
+// unmirrored run already covers.
+void ellipseSpan(const ellipse *e, const ellipserun *r, int sx, int sy,
+		const lcdcolor *shade, const uint16_t *depth, int k)
+{
+	int16_t xa = r->xa, ya = r->ya;
 
-	lcd = get3DTransform(rtl3D);
+	if (sx < 0 && xa == 0) xa = 1;
+	if (sy < 0 && ya == 0) ya = 1;
+	if (xa > r->xb || ya > r->yb)
 
-	drawLine(lcd.x, lcd.y, end.x, end.y, RED);
-	designTreeIn3D(end3D, rtl3D, level - 1, lambda, showOn);
+	 return;
 
-	rtr3D = rotate_pointIn3D(c3D, end3D, -pi/6, showOn);
+	zb_ink = depth ? depth[k] : 0;
 
-	lcd = get3DTransform(rtr3D);
+	if (ya == r->yb)
+	 drawHSpan(e->x0 + sx*xa, e->x0 + sx*r->xb, e->y0 + sy*ya, shade[k]);
+	else
+	 drawVSpan(e->x0 + sx*xa, e->y0 + sy*ya, e->y0 + sy*r->yb, shade[k]);
 
-	drawLine(lcd.x, lcd.y, end.x, end.y, RED);
-	designTreeIn3D(end3D, rtr3D, level - 1, lambda, showOn);
+	zb_ink = 0;
 }
 
-// This method is used to rotate the cube with respect to Zw axis alone
-// Note that, this method is written to visualize the arbitrary vector rotation written below
-Pts3D rotate3DZwAxis(int angle, float cube_x, float cube_y, float cube_z)
+// Add the outline pixel (x,y) of sector q to the run, drawing the run and
+// its mirrors when the pixel does not continue it. Whole runs keep the
+// outline to a few spans per row or column, which the display list stores
+// as one entry each, with the depth of its sector when there is a <depth>.
+// q = -1 flushes the last run.
+void ellipseRun(const ellipse *e, ellipserun *r, int16_t x, int16_t y, int q,
+		const lcdcolor *shade, const uint16_t *depth, int shades)
 {
-	Pts3D final;
-	float angle_rad;
+	int n = shades / 4;
 
-	angle_rad = (pi * angle) / 180;
+	if (r->q >= 0 && q == r->q)
+	{
+		// the next pixel to the right on a row, or below on a column
+		if (y == r->yb && r->ya == r->yb && x == r->xb + 1)
+		{
+			r->xb = x;
+			return;
+		}
 
-	final.x_value = cube_x*cos(angle_rad) - cube_y*sin(angle_rad);
-	final.y_value = cube_y*cos(angle_rad) + cube_x*sin(angle_rad);
-	final.z_value = cube_z;
+		if (x == r->xb && r->xa == r->xb && y == r->ya - 1)
+		{
+			r->ya = y;
+			return;
+		}
+	}
 
-	return final;
+	if (r->q >= 0)
+	{
+		if (n == 0)
+		{
+			ellipseSpan(e, r, 1, 1, shade, depth, 0);
+			ellipseSpan(e, r, -1, 1, shade, depth, 0);
+			ellipseSpan(e, r, -1, -1, shade, depth, 0);
+			ellipseSpan(e, r, 1, -1, shade, depth, 0);
+		}
+		else
+		{
+			ellipseSpan(e, r, 1, 1, shade, depth, r->q);
+			ellipseSpan(e, r, -1, 1, shade, depth, 2*n - 1 - r->q);
+			ellipseSpan(e, r, -1, -1, shade, depth, 2*n + r->q);
+			ellipseSpan(e, r, 1, -1, shade, depth, 4*n - 1 - r->q);
+		}
+	}
+
+	r->xa = r->xb = x;
+	r->ya = r->yb = y;
+	r->q = q;
 }
 
-//	This method is used to rotate the cube with respect to an arbitrary vector
-Pts3D rotateCoord3D(Pts3D ARBPi, Pts3D ARBPi1, int angle, float cube_x, float cube_y, float cube_z)
+// Midpoint ellipse: walk the first quadrant from (0,b) to (a,0), stepping x
+// while the slope is below one and y after, with the decision variables
+// scaled by 4 to stay integer. shade holds <shades> colors around the
+// outline (1 for a single color) and depth, when given, the depth of each;
+// a filled ellipse uses shade[0].
+void drawEllipse(const ellipse *e, const lcdcolor *shade, const uint16_t *depth, int shades, int filled)
 {
-	Pts3D ARBPi1_T, ARBPi1_R;
-	Pts3D cube_T, cube_Rzw, cube_Ryw, cube_Rzw_main, cube_Ryw_reverse, cube_Rzw_reverse, cube_Treverse;
+	int64_t a2 = (int64_t)e->a * e->a, b2 = (int64_t)e->b * e->b;
+	int64_t px, py, p;
+	int16_t x = 0, y = e->b;
+	int32_t cs[ELLIPSE_SHADES/4], sn[ELLIPSE_SHADES/4];
+	int n = (shades >= 4) ? shades / 4 : 1;
+	int q = n - 1, k;
+	fix16 t, c;
+	ellipserun r;
 
-	float cos_alpha_dash, sin_alpha_dash, cos_alpha_doubledash, sin_alpha_doubledash;
+	if (e->a <= 0 || e->b <= 0 || n > ELLIPSE_SHADES/4)
 
-	float denom1, denom2;
-
-	float angle_rad;
+	 return;
 
-	//Step1: Translation
-		//Find new Pi+1 point after Translation for calculating cos(alpha_dash) and sin(alpha_dash) values
-		ARBPi1_T.x_value = ARBPi1.x_value - ARBPi.x_value;
-		ARBPi1_T.y_value = ARBPi1.y_value - ARBPi.y_value;
-		ARBPi1_T.z_value = ARBPi1.z_value - ARBPi.z_value;
+	// sector boundaries, (x,y) is past boundary k when y*a*cos < x*b*sin
+	for (k = 1; k < n; k++)
+	{
+		fix_sincos(k * FIX_ANGLE_QUARTER / n, &t, &c);
+		cs[k] = c >> 6;
+		sn[k] = t >> 6;
+	}
 
-		//Multiply Translation matrix with the given cube point
-		cube_T.x_value = cube_x - ARBPi.x_value;
-		cube_T.y_value = cube_y - ARBPi.y_value;
-		cube_T.z_value = cube_z - ARBPi.z_value;
+	r.q = -1;
+	px = 0;
+	py = 2 * a2 * y;
+	p = 4 * b2 - 4 * a2 * e->b + a2;
 
-	//Step2: Rotation with respect to Zw axis (Note that here alpha_dash will be negative since rotation is clockwise => so this changes the rotation_Zw matrix)
-		//Calculate cos(alpha_dash) and sin(alpha_dash) values
-		denom1 = sqrt(pow(ARBPi1_T.x_value,2) + pow(ARBPi1_T.y_value,2));
-		cos_alpha_dash = ARBPi1_T.x_value / denom1;
-		sin_alpha_dash = ARBPi1_T.y_value / denom1;
+	// Region 1
+	while (px < py)
+	{
+		while (q > 0 && (int64_t)y * e->a * cs[q] < (int64_t)x * e->b * sn[q])
+		 q--;
 
-		//Find new Pi+1 point after Rotation. This new point is used in calculating the cos(alpha_doubledash) and sin(alpha_doubledash) values
-		ARBPi1_R.x_value = ARBPi1_T.x_value*cos_alpha_dash + ARBPi1_T.y_value*sin_alpha_dash;
-		ARBPi1_R.y_value = ARBPi1_T.y_value*cos_alpha_dash - ARBPi1_T.x_value*sin_alpha_dash;
-		ARBPi1_R.z_value = ARBPi1_T.z_value;
+		if (!filled)
+		 ellipseRun(e, &r, x, y, q, shade, depth, shades);
 
-		//Multiply Rotation_Zw matrix with the translated cube point
-		cube_Rzw.x_value = cube_T.x_value*cos_alpha_dash + cube_T.y_value*sin_alpha_dash;
-		cube_Rzw.y_value = cube_T.y_value*cos_alpha_dash - cube_T.x_value*sin_alpha_dash;
-		cube_Rzw.z_value = cube_T.z_value;
+		x++;
+		px += 2 * b2;
 
-	//Step3: Rotation with respect to Yw axis (Note that here alpha_doubledash will be negative since rotation is clockwise => so this changes the rotation_Yw matrix)
-		//Calculate cos(alpha_dash) and sin(alpha_dash) values
-		denom2 = sqrt(pow(ARBPi1_R.x_value,2) + pow(ARBPi1_R.z_value,2));
-		cos_alpha_doubledash = ARBPi1_R.z_value / denom2;
-		sin_alpha_doubledash = ARBPi1_R.x_value / denom2;
+		if (p < 0)
+		{
+			p += 4 * (b2 + px);
+		}
+		else
+		{
+			// leaving row y, its span reaches x - 1
+			if (filled)
+			{
+				drawHSpan(e->x0 - x + 1, e->x0 + x - 1, e->y0 + y, shade[0]);
+				drawHSpan(e->x0 - x + 1, e->x0 + x - 1, e->y0 - y, shade[0]);
+			}
 
-		//Multiply Rotation_Yw matrix with the rotated_Zw cube point
-		cube_Ryw.x_value = cube_Rzw.x_value*cos_alpha_doubledash - cube_Rzw.z_value*sin_alpha_doubledash;
-		cube_Ryw.y_value = cube_Rzw.y_value;
-		cube_Ryw.z_value = cube_Rzw.z_value*cos_alpha_doubledash + cube_Rzw.x_value*sin_alpha_doubledash;
+			y--;
+			py -= 2 * a2;
+			p += 4 * (b2 + px - py);
+		}
+	}
 
-	//Step4: Rotation with respect to Zw axis
-		//change given angle from degrees to radians
-		angle_rad = (pi * angle) / 180;
+	// Region 2
+	p = b2 * (2 * x + 1) * (2 * x + 1) + 4 * a2 * (y - 1) * (y - 1) - 4 * a2 * b2;
 
-		//Multiply Rotation_Yw matrix with the rotated_Yw cube point
-		cube_Rzw_main.x_value = cube_Ryw.x_value*cos(angle_rad) - cube_Ryw.y_value*sin(angle_rad);
-		cube_Rzw_main.y_value = cube_Ryw.y_value*cos(angle_rad) + cube_Ryw.x_value*sin(angle_rad);
-		cube_Rzw_main.z_value = cube_Ryw.z_value;
+	while (y >= 0)
+	{
+		while (q > 0 && (int64_t)y * e->a * cs[q] < (int64_t)x * e->b * sn[q])
+		 q--;
 
-	//Step5: Revert back the Rotation with respect to Yw axis
-		//Multiply Rotation_Yw matrix with the rotated_Zw_main cube point
-		cube_Ryw_reverse.x_value = cube_Rzw_main.x_value*cos_alpha_doubledash + cube_Rzw_main.z_value*sin_alpha_doubledash;
-		cube_Ryw_reverse.y_value = cube_Rzw_main.y_value;
-		cube_Ryw_reverse.z_value = cube_Rzw_main.z_value*cos_alpha_doubledash - cube_Rzw_main.x_value*sin_alpha_doubledash;
+		if (filled)
+		{
+			drawHSpan(e->x0 - x, e->x0 + x, e->y0 + y, shade[0]);
+			if (y)
+			 drawHSpan(e->x0 - x, e->x0 + x, e->y0 - y, shade[0]);
+		}
+		else
+		 ellipseRun(e, &r, x, y, q, shade, depth, shades);
 
-	//Step6: Revert back the Rotation with respect to Zw axis
-		//Multiply Rotation_Yw matrix with the rotated_Yw_reverse cube point
-		cube_Rzw_reverse.x_value = cube_Ryw_reverse.x_value*cos_alpha_dash - cube_Ryw_reverse.y_value*sin_alpha_dash;
-		cube_Rzw_reverse.y_value = cube_Ryw_reverse.y_value*cos_alpha_dash + cube_Ryw_reverse.x_value*sin_alpha_dash;
-		cube_Rzw_reverse.z_value = cube_Ryw_reverse.z_value;
+		y--;
+		py -= 2 * a2;
 
-	//Step7: Revert back the Translation
-		//Multiply Translation matrix with the given cube point
-		cube_Treverse.x_value = cube_Rzw_reverse.x_value + ARBPi.x_value;
-		cube_Treverse.y_value = cube_Rzw_reverse.y_value + ARBPi.y_value;
-		cube_Treverse.z_value = cube_Rzw_reverse.z_value + ARBPi.z_value;
+		if (p > 0)
+		{
+			p += 4 * (a2 - py);
+		}
+		else
+		{
+			x++;
+			px += 2 * b2;
+			p += 4 * (a2 - py + px);
+		}
+	}
 
-	return cube_Treverse;
+	if (!filled)
+	 ellipseRun(e, &r, 0, 0, -1, shade, depth, shades);
 }
 
-// method to draw the cube
-void drawCube()
+// Method to draw the half sphere using contours. Every pixel is drawn with
+// the depth of its contour point in zb_ink, so that once it is in a display
+// list the cube and the shadow are depth tested against it.
+void drawSphere()
 {
-	#define UpperBD 52
-	#define NumOfPts 16
+	#define TotalPts 360
+	#define NumOfLevels 20
+	#define JoinPts 40		// points per contour joined to the next contour
+	#define SphereBatch 36	// points per transformPoints call, divides TotalPts
 
+	// The equi-distant points of a contour that are joined to the next one,
+	// already in the pixel coordinates drawLine takes
 	typedef struct
 	{
-		float X[UpperBD]; float Y[UpperBD]; float Z[UpperBD];
-	}pworld;
+		int16_t X[JoinPts]; int16_t Y[JoinPts];
+		lcdcolor color[JoinPts];
+		uint16_t depth[JoinPts];
+	}pjoin;
 
+	// One batch of contour points in world and perspective coordinates
 	typedef struct
 	{
-		float X[UpperBD]; float Y[UpperBD]; float Z[UpperBD];
-	}pviewer;
+		coord X[SphereBatch]; coord Y[SphereBatch]; coord Z[SphereBatch];
+		coord PX[SphereBatch]; coord PY[SphereBatch];
+		int color[SphereBatch];
+		uint16_t depth[SphereBatch];
+	}pbatch;
+
+	pjoin PC[2];		// the contour below and the one being drawn
+	pjoin *cur, *prev;
+	pbatch B;
+	Pts3D temp3D;
+	ellipse E;
+
+	lcdcolor shade[ELLIPSE_SHADES];
+	uint16_t shadeDepth[ELLIPSE_SHADES];
+
+	coord s, c;
+	int radius = 100;
+	int k, i, j, level, step, n, sampled;
 
-	typedef struct
+	for(level=0;level<=NumOfLevels-1;level++)
 	{
-		float X[UpperBD]; float Y[UpperBD];
-	}pperspective;
+		cur = &PC[level & 1];
+		prev = &PC[(level + 1) & 1];
+		k = 0;
 
-	pworld WCS;
-	pviewer V;
-	pperspective P;
-	Pts3D Vsingle, RWCS, ARBPi, ARBPi1;
-	Pts2D Psingle;
-	float_t L1,L2,L3,L4;
-	int angle, i;
+		// A contour that projects to a clean ellipse is rasterized as one,
+		// then only the points joined to the next contour are transformed
+		sampled = !projectCircle(0, 0, coord_from_int(4*level), coord_from_int(radius), &E);
+		step = sampled ? 1 : TotalPts/JoinPts;
 
-	angle = -5; //minus for clockwise
+		if (!sampled)
+		{
+			ellipseShades(&E, 0, 0, coord_from_int(4*level), coord_from_int(radius), 0.0, 1.0, 0.0, shade, shadeDepth);
+			drawEllipse(&E, shade, shadeDepth, ELLIPSE_SHADES, 0);
+		}
 
-	// Origin
-	WCS.X[0]=0.0; WCS.Y[0]=0.0; WCS.Z[0]=0.0;
+		// Points go through the pipeline SphereBatch at a time, keeping whole
+		// contours in world, viewer and perspective arrays would take 11K of stack
+		for(i=0;i<TotalPts;i+=n*step)
+		{
+			for(n=0;n<SphereBatch && i+n*step<TotalPts;n++)
+			{
+				// Logic to draw a circle using angles
+				angleSinCos(fix_angle_from_deg(i+n*step), &s, &c);
+				temp3D.x_value = 0 + radius*c;
+				temp3D.y_value =  0 + radius*s;
+				temp3D.z_value = coord_from_int(4*level);	// Elevate the contour using Z_w each level
 
-	// Axes
-	WCS.X[1]=200.0; WCS.Y[1]=0.0; WCS.Z[1]=0.0;
-	WCS.X[2]=0.0; WCS.Y[2]=200.0; WCS.Z[2]=0.0;
-	WCS.X[3]=0.0; WCS.Y[3]=0.0;	WCS.Z[3]=200.0;
+				B.X[n] = temp3D.x_value;
+				B.Y[n] = temp3D.y_value;
+				B.Z[n] = temp3D.z_value;
 
-	// New points to define the cube center as (80,80,35)
-	WCS.X[4]=55.0; WCS.Y[4]=55.0; WCS.Z[4]=10.0;
-	WCS.X[5]=55.0; WCS.Y[5]=55.0; WCS.Z[5]=60.0;
-	WCS.X[6]=55.0; WCS.Y[6]=105.0; WCS.Z[6]=10.0;
-	WCS.X[7]=55.0; WCS.Y[7]=105.0; WCS.Z[7]=60.0;
-	WCS.X[8]=105.0; WCS.Y[8]=55.0; WCS.Z[8]=10.0;
-	WCS.X[9]=105.0; WCS.Y[9]=55.0; WCS.Z[9]=60.0;
-	WCS.X[10]=105.0; WCS.Y[10]=105.0; WCS.Z[10]=10.0;
-	WCS.X[11]=105.0; WCS.Y[11]=105.0; WCS.Z[11]=60.0;
+				//Bonus point question task
+				B.color[n] = getDiffuseColor(temp3D, 0.0, 1.0, 0.0);
+				B.depth[n] = getViewerDepth(temp3D);
+			}
 
-	//Define given Arbitrary vectors
-	ARBPi.x_value=0.0; ARBPi.y_value=0.0; ARBPi.z_value=35.0;
-	ARBPi1.x_value=200.0; ARBPi1.y_value=220.0; ARBPi1.z_value=40.0;
+			// World to Viewer to perspective transform
+			transformPoints(B.X, B.Y, B.Z, n, B.PX, B.PY);
 
-	//For loop to rotate each vertex of the cube and get new coordinates
-	for(i=4;i<12;i++)
-	{
-		RWCS = rotateCoord3D(ARBPi, ARBPi1, angle, WCS.X[i], WCS.Y[i], WCS.Z[i]);
-		//RWCS = rotate3DZwAxis(angle, WCS.X[i], WCS.Y[i], WCS.Z[i]);
-		WCS.X[i] = RWCS.x_value;
-		WCS.Y[i] = RWCS.y_value;
-		WCS.Z[i] = RWCS.z_value;
-	}
+			for(j=0;j<n;j++)
+			{
+				//Bonus point question task
+				if (sampled)
+				{
+					zb_ink = B.depth[j];
+					drawPixel(coord_pixel(B.PX[j]), coord_pixel(B.PY[j]), B.color[j]);
+				}
+
+				// Logic to store a selected number of equi-distant points on each contour.
+				// In this case, for each contour, 40 points are selected and joined to the next.
+				if((i+j*step)%(TotalPts/JoinPts) == 0)
+				{
+					cur->X[k] = coord_pixel(B.PX[j]);
+					cur->Y[k] = coord_pixel(B.PY[j]);
+
+					//Bonus point question task
+					cur->color[k] = B.color[j];
+					cur->depth[k++] = B.depth[j];
+				}
+			}
+		}
 
-	//Shadow Calculation
+		// Logic to join the equi-distant points of the contour below to this one
+		for(k=0;level>0 && k<JoinPts;k++)
+		{
+			//Bonus point question task
+			zb_ink = prev->depth[k];
+			drawLine(prev->X[k], prev->Y[k], cur->X[k], cur->Y[k], prev->color[k]);
+		}
 
-	// Point of Light Source PS(-20, -20, 220)
-	WCS.X[12]=Psx; WCS.Y[12]=Psy; WCS.Z[12]=Psz;
+		zb_ink = 0;
 
-	Pts3D Ps;
-	Ps.x_value = WCS.X[12]; Ps.y_value = WCS.Y[12]; Ps.z_value = WCS.Z[12];
+		radius-=0.25*level;	// decrease radius of each contour when level increases and Z_w increases
+	}
+}
 
-	Pts3D P1;
-	P1.x_value = WCS.X[5]; P1.y_value = WCS.Y[5]; P1.z_value = WCS.Z[5];
+// World axes from the origin
+void drawAxes()
+{
+	coord X[4] = {COORD(0.0), COORD(200.0), COORD(0.0), COORD(0.0)};
+	coord Y[4] = {COORD(0.0), COORD(0.0), COORD(200.0), COORD(0.0)};
+	coord Z[4] = {COORD(0.0), COORD(0.0), COORD(0.0), COORD(200.0)};
+	coord PX[4], PY[4];
+	int16_t SX[4], SY[4];
+	Pts3D origin = {COORD(0.0), COORD(0.0), COORD(0.0)};
+	int i;
 
-	Pts3D P2;
-	P2.x_value = WCS.X[9]; P2.y_value = WCS.Y[9]; P2.z_value = WCS.Z[9];
+	transformPoints(X, Y, Z, 4, PX, PY);
 
-	Pts3D P3;
-	P3.x_value = WCS.X[11]; P3.y_value = WCS.Y[11]; P3.z_value = WCS.Z[11];
+	for (i = 0; i < 4; i++)
+	{
+		SX[i] = coord_pixel(PX[i]);
+		SY[i] = coord_pixel(PY[i]);
+	}
 
-	Pts3D P4;
-	P4.x_value = WCS.X[7]; P4.y_value = WCS.Y[7]; P4.z_value = WCS.Z[7];
+	// X and Y lie on the ground and are shadowed like it. Z stands above
+	// the ground and is drawn with the depth of its foot, its farthest point.
+	drawLine(SX[0],SY[0],SX[1],SY[1],RED);
+	drawLine(SX[0],SY[0],SX[2],SY[2],LCD_COLOR(0x00FF00));
 
-	// Shadow Points
+	zb_ink = getViewerDepth(origin);
+	drawLine(SX[0],SY[0],SX[3],SY[3],LCD_COLOR(0x0000FF));
+	zb_ink = 0;
+}
 
-	Pts3D S1,S2,S3,S4;
-	L1 = Lambda3D(WCS.Z[5],WCS.Z[12]);
-	L2 = Lambda3D(WCS.Z[9],WCS.Z[12]);
-	L3 = Lambda3D(WCS.Z[11],WCS.Z[12]);
-	L4 = Lambda3D(WCS.Z[7],WCS.Z[12]);
-	S1 = ShadowPoint3D(P1,Ps,L1);
-	S2 = ShadowPoint3D(P2,Ps,L2);
-	S3 = ShadowPoint3D(P3,Ps,L3);
-	S4 = ShadowPoint3D(P4,Ps,L4);
+// The sphere and the axes do not change between frames, they are rasterized
+// once into a display list and replayed from then on
+#define DL_BACKGROUND_RUNS (DL_POOL_BYTES/sizeof(dlrun))
 
-	WCS.X[13]=S1.x_value;		WCS.Y[13]=S1.y_value;		WCS.Z[13]=S1.z_value; //S1
-	WCS.X[14]=S2.x_value;		WCS.Y[14]=S2.y_value;		WCS.Z[14]=S2.z_value; //S2
-	WCS.X[15]=S3.x_value;		WCS.Y[15]=S3.y_value;		WCS.Z[15]=S3.z_value; //S3
-	WCS.X[16]=S4.x_value;		WCS.Y[16]=S4.y_value;		WCS.Z[16]=S4.z_value; //S4
+#if USE_DISPLAY_LIST
+static dlrun background_runs[DL_BACKGROUND_RUNS];
+static displaylist background_dl;
+static int background_dl_valid = 0;
+#endif
 
-	// World to Viewer Transform for each point
-	for(int i=0;i<=NumOfPts;i++)
-	{
-		Vsingle = getWorld2Viewer(WCS.X[i], WCS.Y[i], WCS.Z[i]);
-		V.X[i] = Vsingle.x_value;
-		V.Y[i] = Vsingle.y_value;
-		V.Z[i] = Vsingle.z_value;
-	}
+// Whether the background can be repainted in part, from its display list
+int backgroundCached()
+{
+#if USE_DISPLAY_LIST
+	return background_dl_valid;
+#else
+	return 0;
+#endif
+}
 
-	// Viewer to perspective transform for each point
-	for(int i=0;i<=NumOfPts;i++)
+// Draw the static layers from their display list, recording the list on
+// first use. Once there is a list, a <clip> box repaints only what lies
+// inside it. If the list does not fit, the whole background is drawn the
+// long way every time.
+void drawBackground(const scrbox *clip)
+{
+#if USE_DISPLAY_LIST
+	if (background_dl_valid)
 	{
-		Psingle = getViewer2Perspective(V.X[i], V.Y[i], V.Z[i]);
-		P.X[i]=Psingle.x;
-		P.Y[i]=Psingle.y;
+		dl_play(&background_dl, clip);
+		return;
 	}
 
-	Pts3D temp_pt;
+	dl_begin(&background_dl, background_runs, DL_BACKGROUND_RUNS);
+	drawSphere();
+	drawAxes();
+	background_dl_valid = dl_end();
+
+	// From here on the depth buffer takes the background's depth from it
+	if (background_dl_valid)
+	 dl_depth_from(&background_dl);
+#else
+	drawSphere();
+	drawAxes();
+#endif
+}
 
-	temp_pt.x_value = WCS.X[5]; temp_pt.y_value = WCS.Y[5]; temp_pt.z_value = WCS.Z[5];
+/*****************************************************************************
 
-	float temp_color;
+** Frame scheduler
 
-	temp_color = getDiffuseColor(temp_pt, 0.8, 0.0, 0.0);
+** Frames are due on fixed slots of 1/FRAME_RATE seconds of the frame_us()
+** clock; frame_wait() sleeps until the next one and tells
+** the caller how many slots went by, so animation can advance by time
+** rather than by frames drawn. frame_stage() charges the time since the
+** previous call to one stage of the frame.
 
-	// Draw Lines for all the edges of the cube
-	drawLine(P.X[0],P.Y[0],P.X[1],P.Y[1],RED);
-	drawLine(P.X[0],P.Y[0],P.X[2],P.Y[2],0x00FF00);
-	drawLine(P.X[0],P.Y[0],P.X[3],P.Y[3],0x0000FF);
+*****************************************************************************/
 
-	//New Centered Cube DrawLines
-	drawLine(P.X[6],P.Y[6],P.X[4],P.Y[4],WHITE);
-	drawLine(P.X[10],P.Y[10],P.X[8],P.Y[8],WHITE);
-	drawLine(P.X[6],P.Y[6],P.X[10],P.Y[10],BLUE);
-	drawLine(P.X[8],P.Y[8],P.X[4],P.Y[4],WHITE);
+typedef enum
+{
+	STAGE_CLEAR, STAGE_BACKGROUND, STAGE_CUBE, STAGE_FLUSH, STAGES
+}framestage;
 
-	drawLine(P.X[7],P.Y[7],P.X[5],P.Y[5],temp_color);
-	drawLine(P.X[7],P.Y[7],P.X[11],P.Y[11],WHITE);
-	drawLine(P.X[9],P.Y[9],P.X[11],P.Y[11],WHITE);
-	drawLine(P.X[9],P.Y[9],P.X[5],P.Y[5],temp_color);
+typedef struct
+{
+	uint32_t period;			// us per slot
+	uint32_t due;				// us, start of the current slot
+	uint32_t mark;				// us, end of the last stage
+	uint32_t report;			// us, start of the stats interval
+	uint32_t frames;			// frames drawn in the interval
+	uint32_t skipped;			// slots skipped in the interval
+	uint32_t stage[STAGES];		// us per stage in the interval
+}framesched;
+
+static framesched sched;
+
+void frame_init(uint32_t rate)
+{
+	framesched *f = &sched;
 
-	drawLine(P.X[9],P.Y[9],P.X[8],P.Y[8],temp_color);
-	drawLine(P.X[11],P.Y[11],P.X[10],P.Y[10],WHITE);
-	drawLine(P.X[5],P.Y[5],P.X[4],P.Y[4],temp_color);
-	drawLine(P.X[7],P.Y[7],P.X[6],P.Y[6],BLUE);
+	SystemCoreClockUpdate();
+	SysTick_Config(SystemCoreClock / FRAME_TICK_HZ);
 
-	// Shadow Drawlines
-	drawLine(P.X[13],P.Y[13],P.X[14],P.Y[14],DARKBLUE);
-	drawLine(P.X[14],P.Y[14],P.X[15],P.Y[15],DARKBLUE);
-	drawLine(P.X[16],P.Y[16],P.X[15],P.Y[15],DARKBLUE);
-	drawLine(P.X[16],P.Y[16],P.X[13],P.Y[13],DARKBLUE);
+	memset(f, 0, sizeof(*f));
+	f->period = 1000000 / rate;
+	f->due = f->mark = f->report = frame_us();
+}
 
-	double xvaluestart = S1.x_value;
-	double xvalueend = S2.x_value;
-	double yvaluestart = S1.y_value;
-	double yvalueend = S4.y_value;
+void frame_stage(framestage s)
+{
+	uint32_t now = frame_us();
 
-	//Shadow fill
-	for(double x=xvaluestart;x<=xvalueend;x+=1.234)
-		for(double y=yvaluestart;y<=yvalueend;y+=1.234)
-		{
-			Pts3D pt; Pts2D pt_new;
-			pt.x_value=x; pt.y_value=y; pt.z_value=0;
-			pt_new = get3DTransform(pt);
-			drawPixel(pt_new.x,pt_new.y,DARKBLUE);
-		}
+	sched.stage[s] += now - sched.mark;
+	sched.mark = now;
+}
 
-	//Red - top side diffuse reflection fill
-	float diff_color;
-	for(float y=WCS.Y[5];y<=WCS.Y[6];y+=0.9888)
-		for(float x=WCS.X[4];x<=WCS.X[8];x+=0.9888)
-		{
-			Pts3D pt; Pts2D pt2d;
-			pt.x_value=x; pt.y_value=y; pt.z_value=WCS.Z[5];
-			pt2d = get3DTransform(pt);
-			// RED DIFFUSE
-			diff_color = getDiffuseColor(pt, 0.8, 0.0, 0.0);
-			drawPixel(pt2d.x,pt2d.y,diff_color);
-		}
+#if FRAME_STATS
+// Print what the last FRAME_STATS seconds looked like and start over
+void frame_report(uint32_t now)
+{
+	framesched *f = &sched;
+	uint32_t elapsed = now - f->report;
+	int s;
+
+	printf("%u.%02u fps, %u skipped, us/frame:", (unsigned)(f->frames * 1000000ULL / elapsed),
+			(unsigned)(f->frames * 100000000ULL / elapsed % 100), (unsigned)f->skipped);
+	for (s = 0; s < STAGES; s++)
+	 printf(" %u", (unsigned)(f->frames ? f->stage[s] / f->frames : 0));
+#if LCD_USE_TE
+	printf(", TE held %u bursts for %u us", (unsigned)lcd_te.held, (unsigned)lcd_te.wait);
+	lcd_te.held = lcd_te.wait = 0;
+#endif
+	printf("\n");
+
+	f->report = now;
+	f->frames = f->skipped = 0;
+	memset(f->stage, 0, sizeof(f->stage));
+}
+#endif
 
-	//Front side Fill
-	for(float y=WCS.Y[5];y<=WCS.Y[6];y+=0.988)
-		for(float z=WCS.Z[5];z>=WCS.Z[4];z-=0.988)
-		{
-			Pts3D pt; Pts2D pt2d;
-			pt.x_value=WCS.X[8]; pt.y_value=y; pt.z_value=z;
-			pt2d = get3DTransform(pt);
-			drawPixel(pt2d.x,pt2d.y,0xf59105);
-		}
+// End the frame: sleep until the next slot, or when the frame ran over,
+// drop the slots it overran into. Returns the number of slots that passed.
+uint32_t frame_wait()
+{
+	framesched *f = &sched;
+	uint32_t now = frame_us(), slots = 1;
 
-	//Right side Fill
-	for(float z=WCS.Z[5];z>=WCS.Z[4];z-=0.988)
-		for(float x=WCS.X[8];x>=WCS.X[4];x-=0.988)
-		{
-			Pts3D pt; Pts2D pt2d;
-			pt.x_value=x; pt.y_value=WCS.Y[6]; pt.z_value=z;
-			pt2d = get3DTransform(pt);
-			drawPixel(pt2d.x,pt2d.y,0x5905f5);
-		}
+	f->frames++;
+	f->due += f->period;
 
-	//Draw Tree on the given visible side
-	int cube_side = 50;
-	char showOn[] = "Right";
+	if ((int32_t)(now - f->due) >= 0)
+	{
+		slots += (now - f->due) / f->period + 1;
+		f->skipped += slots - 1;
+		f->due += (slots - 1) * f->period;
+	}
 
-	drawTree(WCS.X[4], WCS.Y[4], WCS.Z[4], cube_side, showOn);
+	while ((int32_t)(frame_us() - f->due) < 0)
+	 __WFI();
+
+	f->mark = frame_us();
+
+#if FRAME_STATS
+	if (f->mark - f->report >= FRAME_STATS * 1000000U)
+	{
+		frame_report(f->mark);
+		f->mark = frame_us();
+	}
+#endif
+
+	return slots;
 }
 
-// Method to draw the half sphere using contours
-void drawSphere()
+// Draw one frame of the scene with the cube turned by <angle> degrees. The
+// first frame, or every frame when the background has no display list to
+// repaint parts of it from, clears the whole panel; later ones only clear
+// where the cube and its shadow were.
+void drawScene(int angle)
 {
-	#define UpperBD 360
-	#define UpperPCBD 800
-	#define TotalPts 360
-	#define NumOfLevels 20
+	static scrbox foot[FOOTPRINTS];
+	static int drawn = 0;
+	int i, partial = 0;
 
-	typedef struct
-	{
-		float X[UpperBD]; float Y[UpperBD]; float Z[UpperBD];
-	}pworld;
+#if USE_INCREMENTAL_REDRAW
+	partial = drawn && backgroundCached();
+#endif
 
-	typedef struct
+	if (partial)
 	{
-		float X[UpperBD]; float Y[UpperBD]; float Z[UpperBD];
-	}pviewer;
+		for (i = 0; i < FOOTPRINTS; i++)
+		 if (foot[i].x0 <= foot[i].x1)
+		  fillrect(foot[i].x0, foot[i].y0, foot[i].x1, foot[i].y1, BLACK);
+	}
+	else
+		fillrect(0, 0, ST7735_TFTWIDTH, ST7735_TFTHEIGHT, BLACK);
 
-	typedef struct
-	{
-		float X[UpperBD]; float Y[UpperBD];
-	}pperspective;
+	zb_clear();
 
-	// Structure to hold the equi-distant points on each contour
-	typedef struct
+	frame_stage(STAGE_CLEAR);
+
+	if (partial)
 	{
-		float X[UpperPCBD]; float Y[UpperPCBD]; float Z[UpperPCBD];
-	}pcontour;
+		for (i = 0; i < FOOTPRINTS; i++)
+		 if (foot[i].x0 <= foot[i].x1)
+		  drawBackground(&foot[i]);
+	}
+	else
+		drawBackground(0);
 
-	pworld WCS;
-	pviewer V;
-	pperspective P;
-	pcontour PC;
-	Pts3D Vsingle, temp3D;
-	Pts2D Psingle;
+	frame_stage(STAGE_BACKGROUND);
 
-	int diffColor[UpperBD];
-	int diffColorPC[UpperPCBD];
+	for (i = 0; i < FOOTPRINTS; i++)
+	 scrbox_empty(&foot[i]);
 
-	float angle_theta;
-	int radius = 100;
-	int kx=0, ky=0, kz=0, i, level;
+	drawCube(angle, foot);
 
-	for(level=0;level<=NumOfLevels-1;level++)
-	{
-		for(i=0;i<TotalPts;i++)
-		{
-			// Logic to draw a circle using angles
-			angle_theta = i*3.142 /180;
-			WCS.X[i] = 0 + radius*cos(angle_theta);
-			WCS.Y[i] =  0 + radius*sin(angle_theta);
-			WCS.Z[i] = 4*level;	// Elevate the contour using Z_w each level
+	drawn = 1;
 
-			temp3D.x_value = WCS.X[i];
-			temp3D.y_value = WCS.Y[i];
-			temp3D.z_value = WCS.Z[i];
+	frame_stage(STAGE_CUBE);
 
-			//Bonus point question task
-			diffColor[i] = getDiffuseColor(temp3D, 0.0, 1.0, 0.0);
-		}
+	fb_flush();
 
-		// World to Viewer Transform for each point
-		for(i=0;i<TotalPts;i++)
-		{
-			Vsingle = getWorld2Viewer(WCS.X[i], WCS.Y[i], WCS.Z[i]);
-			V.X[i] = Vsingle.x_value;
-			V.Y[i] = Vsingle.y_value;
-			V.Z[i] = Vsingle.z_value;
-		}
+	lcd_sync();
 
-		// Viewer to perspective transform for each point
-		for(i=0;i<TotalPts;i++)
-		{
-			Psingle = getViewer2Perspective(V.X[i], V.Y[i], V.Z[i]);
-			P.X[i]=Psingle.x;
-			P.Y[i]=Psingle.y;
+	frame_stage(STAGE_FLUSH);
+}
 
-			//Bonus point question task
-			drawPixel(P.X[i], P.Y[i], diffColor[i]);
+#if USE_FIXED_POINT && FIXMATH_SELFTEST
+// Error bounds of the fixed point pipeline against float
+#define FIX_TOL_SCREEN 0.05		// pixels
+#define FIX_TOL_WORLD 0.05		// world units
+#define FIX_TOL_DIFFUSE 0.01	// relative
+#define FIX_TOL_DEPTH 0.001		// relative
+#define FIX_TOL_TRIG 0.0001
+#define FIX_SCREEN_RANGE 256	// virtual pixels
+
+// Report the largest error of one path and whether it is within bounds
+int fixmathCheck(const char *name, float err, float tol)
+{
+	printf("fixmath %-12s max error %f (bound %f) %s\n", name, err, tol, (err <= tol) ? "ok" : "FAIL");
+	return err <= tol ? 0 : 1;
+}
 
-			// Logic to store a selected number of equi-distant points on each contour into PC.
-			// In this case, for each contour, 40 points are selected and later joined.
-			if(i%(TotalPts/40) == 0)
-			{
-				PC.X[kx++] = P.X[i];
-				PC.Y[ky++] = P.Y[i];
+// Compare the fixed point pipeline with the same math done in float over the
+// part of world space the scene uses. Returns the number of paths out of
+// bounds.
+int fixmathSelfTest()
+{
+	Pts3D w, a, Ps, ARBPi, ARBPi1;
+	Pts2D p;
+	coordmat rot;
+	fix16 fs, fc;
+	float m[3][4], k[3], v[3], r[3], kv, len, s, c;
+	float e_proj = 0, e_view = 0, e_depth = 0, e_diff = 0, e_rot = 0, e_shadow = 0, e_trig = 0;
+	float x, y, z, vx, vy, vz, px, py, dx, dy, dz, d2, ref, lambda, t;
+	int i, fails = 0;
+
+	cameraMatrix(m);
+
+	Ps.x_value = Psx; Ps.y_value = Psy; Ps.z_value = Psz;
+	ARBPi.x_value = COORD(0.0); ARBPi.y_value = COORD(0.0); ARBPi.z_value = COORD(35.0);
+	ARBPi1.x_value = COORD(200.0); ARBPi1.y_value = COORD(220.0); ARBPi1.z_value = COORD(40.0);
+	rotationMatrix(ARBPi, ARBPi1, -5, &rot);
+
+	// the same axis and angle for Rodrigues' formula
+	k[0] = 200.0; k[1] = 220.0; k[2] = 5.0;
+	len = sqrtf(k[0]*k[0] + k[1]*k[1] + k[2]*k[2]);
+	k[0] /= len; k[1] /= len; k[2] /= len;
+	s = sinf(-5 * 3.14159265f / 180);
+	c = cosf(-5 * 3.14159265f / 180);
+
+	for (x = -100; x <= 250; x += 25)
+	 for (y = -100; y <= 250; y += 25)
+	  for (z = 0; z <= 200; z += 20)
+	  {
+		w.x_value = coord_from_float(x); w.y_value = coord_from_float(y); w.z_value = coord_from_float(z);
+
+		vx = m[0][0]*x + m[0][1]*y + m[0][2]*z + m[0][3];
+		vy = m[1][0]*x + m[1][1]*y + m[1][2]*z + m[1][3];
+		vz = m[2][0]*x + m[2][1]*y + m[2][2]*z + m[2][3];
+
+		// Projections are only compared where they land near the panel,
+		// points close to the eye plane blow up in both versions
+		px = D_focal*vx/vz;
+		py = D_focal*vy/vz;
+		if ((fabsf(px) < FIX_SCREEN_RANGE) && (fabsf(py) < FIX_SCREEN_RANGE))
+		{
+			p = get3DTransform(w);
+			e_proj = fmaxf(e_proj, fmaxf(fabsf(px - coord_to_float(p.x)), fabsf(py - coord_to_float(p.y))));
 
-				//Bonus point question task
-				diffColorPC[kz++] = diffColor[i];
-			}
+			a = getWorld2Viewer(w.x_value, w.y_value, w.z_value);
+			p = getViewer2Perspective(a.x_value, a.y_value, a.z_value);
+			e_view = fmaxf(e_view, fmaxf(fabsf(px - coord_to_float(p.x)), fabsf(py - coord_to_float(p.y))));
 		}
 
-		radius-=0.25*level;	// decrease radius of each contour when level increases and Z_w increases
-	}
+		ref = 65535 * (float)ZB_NEAR / vz;
+		if (vz > ZB_NEAR)
+		 e_depth = fmaxf(e_depth, fabsf(ref - getViewerDepth(w)) / ref);
+
+		dx = coord_to_float(Psx) - x;
+		dy = coord_to_float(Psy) - y;
+		dz = coord_to_float(Psz) - z;
+		d2 = dx*dx + dy*dy + dz*dz;
+		ref = 16000 * dz / sqrtf(d2) / d2;
+		if (fabsf(ref) > 0.001f)
+		 e_diff = fmaxf(e_diff, fabsf(ref - coord_to_float(getDiffuseTerm(w))) / fabsf(ref));
+
+		// v*c + (k x v)*s + k*(k.v)*(1-c) about the axis through ARBPi
+		v[0] = x; v[1] = y; v[2] = z - 35;
+		kv = k[0]*v[0] + k[1]*v[1] + k[2]*v[2];
+		r[0] = v[0]*c + (k[1]*v[2] - k[2]*v[1])*s + k[0]*kv*(1 - c);
+		r[1] = v[1]*c + (k[2]*v[0] - k[0]*v[2])*s + k[1]*kv*(1 - c);
+		r[2] = v[2]*c + (k[0]*v[1] - k[1]*v[0])*s + k[2]*kv*(1 - c) + 35;
+		a = coordmatApply(&rot, w.x_value, w.y_value, w.z_value);
+		e_rot = fmaxf(e_rot, fmaxf(fabsf(r[0] - coord_to_float(a.x_value)),
+				fmaxf(fabsf(r[1] - coord_to_float(a.y_value)), fabsf(r[2] - coord_to_float(a.z_value)))));
+
+		lambda = -z/(coord_to_float(Psz) - z);
+		a = ShadowPoint3D(w, Ps, Lambda3D(w.z_value, Psz));
+		e_shadow = fmaxf(e_shadow, fmaxf(fabsf(x + lambda*dx - coord_to_float(a.x_value)),
+				fabsf(y + lambda*dy - coord_to_float(a.y_value))));
+	  }
 
-	// Logic to join the equi-distant points of one contour to the next contour
-	for(i=0;i<kx;i++)
+	for (i = 0; i < 65536; i += 7)
 	{
-		if((i+40)<kx)
-		//Bonus point question task
-		drawLine(PC.X[i], PC.Y[i], PC.X[i+40], PC.Y[i+40], diffColorPC[i]);
+		fix_sincos(i, &fs, &fc);
+		t = i * (2 * 3.14159265f / 65536);
+		e_trig = fmaxf(e_trig, fmaxf(fabsf(sinf(t) - fix_to_float(fs)), fabsf(cosf(t) - fix_to_float(fc))));
 	}
+
+	fails += fixmathCheck("projection", e_proj, FIX_TOL_SCREEN);
+	fails += fixmathCheck("viewer", e_view, FIX_TOL_SCREEN);
+	fails += fixmathCheck("depth", e_depth, FIX_TOL_DEPTH);
+	fails += fixmathCheck("diffuse", e_diff, FIX_TOL_DIFFUSE);
+	fails += fixmathCheck("rotation", e_rot, FIX_TOL_WORLD);
+	fails += fixmathCheck("shadow", e_shadow, FIX_TOL_WORLD);
+	fails += fixmathCheck("sin/cos", e_trig, FIX_TOL_TRIG);
+
+	return fails;
 }
+#endif
 
 int main (void)
 {
 	uint32_t pnum = 0 ;
+	int angle, n;
 
 	if ( pnum == 0 )
+	{
 		SSP0Init();
+		SSP0DMAInit();
+	}
 	else
 		 puts("Port number is not correct");
 
 	 lcd_init();
 
-	 fillrect(0, 0, ST7735_TFTWIDTH, ST7735_TFTHEIGHT, BLACK);
+#if USE_FIXED_POINT && FIXMATH_SELFTEST
+	 if (fixmathSelfTest())
 
-	 drawSphere();
+	  puts("fixmath: fixed point results out of bounds");
+#endif
 
-	 drawCube();
+#if LCD_SPI_AUTOTUNE
+	 printf("SPI clock: %u Hz (calibrated)\n", (unsigned)lcd_tune_spi());
+#else
+	 printf("SPI clock: %u Hz\n", (unsigned)SSPSetClock(pnum, LCD_SPI_HZ));
+#endif
+
+	 fb_init();
+
+	 frame_init(FRAME_RATE);
+
+	 lcd_te_init();
+
+	 angle = -5; //minus for clockwise
+
+#if ANIMATE
+	 for (n = 0; FRAME_LIMIT == 0 || n < FRAME_LIMIT; n++)
+	 {
+		 drawScene(angle);
+
+		 angle = (angle + FRAME_TURN * (int)frame_wait()) % 360;
+	 }
+#else
+	 drawScene(angle);
+#endif
 
 	 return 0;
 }
@@ -0,0 +1,243 @@
+/****************************************************************************
+ *   Project: 2D and 3D Graphics on the LPC1769
+ *
+ *   Description:
+ *     Q16.16 fixed point scalar, vector, matrix and trig helpers. The
+ *     LPC1769 has no FPU, so these replace soft-float calls in the 3D
+ *     transform, lighting and shadow paths and the 2D tree rotation.
+ *     Both projects carry the same copy of this file.
+ *
+ *     A fix16 holds 16 integer bits (sign included) and 16 fraction bits:
+ *     range is about +/-32768 with a resolution of 1/65536. Squares of
+ *     world distances do not fit in that range, so dot products and
+ *     lengths are done in 64 bits.
+ *
+****************************************************************************/
+#ifndef __FIXMATH_H__
+#define __FIXMATH_H__
+
+#include <stdint.h>
+
+typedef int32_t fix16;
+
+#define FIX_SHIFT		16
+#define FIX_ONE			((fix16)1 << FIX_SHIFT)
+#define FIX_HALF		(FIX_ONE >> 1)
+#define FIX_MAX			((fix16)0x7FFFFFFF)
+#define FIX_MIN			((fix16)0x80000000)
+
+/* Constant conversion, folded by the compiler for literal arguments */
+#define FIX_FROM_INT(i)		((fix16)((i) * FIX_ONE))
+#define FIX_FROM_FLOAT(f)	((fix16)((f) * 65536.0f + ((f) >= 0 ? 0.5f : -0.5f)))
+
+typedef struct
+{
+	fix16 x; fix16 y; fix16 z;
+} fixvec3;
+
+/* Affine transform: 3x3 linear part in columns 0-2, translation in column 3 */
+typedef struct
+{
+	fix16 m[3][4];
+} fixmat34;
+
+static inline fix16 fix_from_float(float f)
+{
+	return FIX_FROM_FLOAT(f);
+}
+
+static inline float fix_to_float(fix16 a)
+{
+	return a * (1.0f / 65536.0f);
+}
+
+/* Integer part, rounded toward zero like a float to int conversion, for
+   screen coordinates going to pixels */
+static inline int32_t fix_trunc(fix16 a)
+{
+	return (a >= 0) ? (a >> FIX_SHIFT) : -((-a) >> FIX_SHIFT);
+}
+
+static inline fix16 fix_saturate(int64_t v)
+{
+	if (v > FIX_MAX)
+		return FIX_MAX;
+	if (v < FIX_MIN)
+		return FIX_MIN;
+	return (fix16)v;
+}
+
+/* a * b, rounded to nearest */
+static inline fix16 fix_mul(fix16 a, fix16 b)
+{
+	return (fix16)(((int64_t)a * b + FIX_HALF) >> FIX_SHIFT);
+}
+
+/* n / d rounded to nearest, for the divisions below */
+static inline int64_t fix_div64(int64_t n, int64_t d)
+{
+	return ((n < 0) == (d < 0)) ? (n + d / 2) / d : (n - d / 2) / d;
+}
+
+/* a / b rounded to nearest, saturating on overflow and division by zero */
+static inline fix16 fix_div(fix16 a, fix16 b)
+{
+	if (b == 0)
+		return (a >= 0) ? FIX_MAX : FIX_MIN;
+
+	return fix_saturate(fix_div64((int64_t)a * FIX_ONE, b));
+}
+
+/* a * b / c with a 64-bit intermediate, for products that leave the Q16.16
+   range before the division brings them back */
+static inline fix16 fix_muldiv(fix16 a, fix16 b, fix16 c)
+{
+	if (c == 0)
+		return ((a ^ b) >= 0) ? FIX_MAX : FIX_MIN;
+
+	return fix_saturate(fix_div64((int64_t)a * b, c));
+}
+
+/* Integer square root of a 64-bit value, rounded down */
+static inline uint32_t fix_isqrt64(uint64_t v)
+{
+	uint64_t res = 0;
+	uint64_t bit = (uint64_t)1 << 62;
+
+	while (bit > v)
+		bit >>= 2;
+
+	while (bit)
+	{
+		if (v >= res + bit)
+		{
+			v -= res + bit;
+			res = (res >> 1) + bit;
+		}
+		else
+			res >>= 1;
+
+		bit >>= 2;
+	}
+
+	return (uint32_t)res;
+}
+
+/* Square root of a Q32.32 value (a sum of fix16 products), as a fix16 */
+static inline fix16 fix_sqrt64(int64_t a)
+{
+	if (a <= 0)
+		return 0;
+
+	return fix_saturate(fix_isqrt64((uint64_t)a));
+}
+
+/* Angles in 1/65536 of a turn: 16384 is a right angle and wrapping around
+   the 16-bit range is wrapping around the circle, so sums and differences
+   of angles need no reduction. */
+typedef uint16_t fixangle;
+
+#define FIX_ANGLE_QUARTER	16384
+
+/* Constant conversion from degrees, folded by the compiler */
+#define FIX_ANGLE_DEG(d)	((fixangle)(int32_t)((d) * (65536.0 / 360.0) + ((d) >= 0 ? 0.5 : -0.5)))
+
+/* Quarter-wave sine table, FIX_SIN_STEPS intervals over [0, 90] degrees
+   plus the end point, in Q16.16. The entries are the Taylor series up to
+   x^13 evaluated by the compiler, which is exact to well below one LSB, so
+   the table is built at compile time without a generator script. */
+#define FIX_SIN_STEPS		256
+#define FIX_SIN_SHIFT		22		/* 32-bit turn to table index */
+
+#define FIX_SIN_X2(x)		((x) * (x))
+#define FIX_SIN_POLY(x)		((x) * (1 - FIX_SIN_X2(x) / 6 * (1 - FIX_SIN_X2(x) / 20 * \
+		(1 - FIX_SIN_X2(x) / 42 * (1 - FIX_SIN_X2(x) / 72 * (1 - FIX_SIN_X2(x) / 110 * \
+		(1 - FIX_SIN_X2(x) / 156)))))))
+#define FIX_SIN_ENTRY(i)	((fix16)(FIX_SIN_POLY((i) * (3.14159265358979323846 / 2 / FIX_SIN_STEPS)) * 65536.0 + 0.5))
+#define FIX_SIN_4(i)		FIX_SIN_ENTRY(i), FIX_SIN_ENTRY((i) + 1), FIX_SIN_ENTRY((i) + 2), FIX_SIN_ENTRY((i) + 3)
+#define FIX_SIN_16(i)		FIX_SIN_4(i), FIX_SIN_4((i) + 4), FIX_SIN_4((i) + 8), FIX_SIN_4((i) + 12)
+#define FIX_SIN_64(i)		FIX_SIN_16(i), FIX_SIN_16((i) + 16), FIX_SIN_16((i) + 32), FIX_SIN_16((i) + 48)
+#define FIX_SIN_256(i)		FIX_SIN_64(i), FIX_SIN_64((i) + 64), FIX_SIN_64((i) + 128), FIX_SIN_64((i) + 192)
+
+static const fix16 fix_sin_table[FIX_SIN_STEPS + 1] =
+{
+	FIX_SIN_256(0), FIX_SIN_ENTRY(FIX_SIN_STEPS)
+};
+
+/* Sine of an angle in 1/2^32 of a turn. The quadrant picks the direction and
+   sign, the next 8 bits the table interval and the 16 bits below them
+   interpolate linearly within it, for an error of about one LSB. */
+static inline fix16 fix_sin_turn(uint32_t a)
+{
+	uint32_t q = a >> 30, r = a & 0x3FFFFFFF, i, f;
+	fix16 s;
+
+	if (q & 1)
+		r = 0x40000000 - r;
+
+	i = r >> FIX_SIN_SHIFT;
+	f = (r >> (FIX_SIN_SHIFT - 16)) & 0xFFFF;
+
+	s = fix_sin_table[i];
+	if (i < FIX_SIN_STEPS)
+		s += (fix16)(((fix_sin_table[i + 1] - s) * (int32_t)f + 0x8000) >> 16);
+
+	return (q & 2) ? -s : s;
+}
+
+/* Sine and cosine of a fixangle with one call */
+static inline void fix_sincos(fixangle a, fix16 *s, fix16 *c)
+{
+	*s = fix_sin_turn((uint32_t)a << 16);
+	*c = fix_sin_turn((uint32_t)(fixangle)(a + FIX_ANGLE_QUARTER) << 16);
+}
+
+/* Whole degrees to a fixangle, rounded to nearest */
+static inline fixangle fix_angle_from_deg(int32_t d)
+{
+	d %= 360;
+	if (d < 0)
+		d += 360;
+
+	return (fixangle)((d * 65536 + 180) / 360);
+}
+
+static inline fixvec3 fixvec3_make(fix16 x, fix16 y, fix16 z)
+{
+	fixvec3 v;
+	v.x = x; v.y = y; v.z = z;
+	return v;
+}
+
+static inline fixvec3 fixvec3_sub(fixvec3 a, fixvec3 b)
+{
+	return fixvec3_make(a.x - b.x, a.y - b.y, a.z - b.z);
+}
+
+/* Dot product in Q32.32, wide enough for squared world distances */
+static inline int64_t fixvec3_dot64(fixvec3 a, fixvec3 b)
+{
+	return (int64_t)a.x * b.x + (int64_t)a.y * b.y + (int64_t)a.z * b.z;
+}
+
+static inline fix16 fixvec3_length(fixvec3 a)
+{
+	return fix_sqrt64(fixvec3_dot64(a, a));
+}
+
+/* m * v + translation, one 64-bit accumulator per row */
+static inline fixvec3 fixmat34_apply(const fixmat34 *m, fixvec3 v)
+{
+	fixvec3 r;
+
+	r.x = (fix16)(((int64_t)m->m[0][0] * v.x + (int64_t)m->m[0][1] * v.y +
+			(int64_t)m->m[0][2] * v.z + FIX_HALF) >> FIX_SHIFT) + m->m[0][3];
+	r.y = (fix16)(((int64_t)m->m[1][0] * v.x + (int64_t)m->m[1][1] * v.y +
+			(int64_t)m->m[1][2] * v.z + FIX_HALF) >> FIX_SHIFT) + m->m[1][3];
+	r.z = (fix16)(((int64_t)m->m[2][0] * v.x + (int64_t)m->m[2][1] * v.y +
+			(int64_t)m->m[2][2] * v.z + FIX_HALF) >> FIX_SHIFT) + m->m[2][3];
+
+	return r;
+}
+
+#endif /* end __FIXMATH_H__ */
@@ -18,6 +18,7 @@
  * warranty that such application will be suitable for the specified
  * use without further testing or modification.
 ****************************************************************************/
+#include <cr_section_macros.h>
 #include "LPC17xx.h"			/* LPC17xx Peripheral Registers */
 #include "ssp.h"
 
@@ -29,6 +30,95 @@ volatile uint32_t interrupt1RxStat = 0;
 volatile uint32_t interrupt1OverRunStat = 0;
 volatile uint32_t interrupt1RxTimeoutStat = 0;
 
+/* frames pushed by the transmit queue whose RX echo is not drained yet */
+static volatile uint32_t streamInFlight[2];
+
+/* Transmit queue, filled by SSPQueue*() and emptied by the SSP interrupt.
+Busy stays set from the first queued entry until SSPQueueFence(), while it
+is set the interrupt handler owns the RX FIFO of the port. */
+static uint32_t sspTxq[2][SSP_TXQ_SIZE];
+static volatile uint32_t sspTxqHead[2];
+static volatile uint32_t sspTxqTail[2];
+static volatile uint32_t sspTxqBusy[2];
+static SSP_QueueHook sspTxqHook[2];
+static volatile uint32_t sspTxqInHook[2];
+
+/* GPDMA transmit engine state, the descriptors must sit in AHB SRAM */
+__BSS(RAM2) static SSP_DMA_LLI sspDmaPool[SSP_DMA_LLI_POOL];
+static volatile uint32_t sspDmaActive = 0;
+static SSP_DMACallback sspDmaCallback;
+volatile uint32_t dmaErrorStat = 0;
+
+/* frame size changes refused because they came from the queue's hook while
+a DMA burst was running */
+volatile uint32_t frameSizeRefusedStat = 0;
+
+/*****************************************************************************
+** Function name:		SSPQueueService
+**
+** Descriptions:		Move queued frames into the TX FIFO, called from the
+**						SSP interrupt. The RX FIFO is drained first and at
+**						most FIFOSIZE frames are kept in flight, so RX never
+**						overruns. A mark waits for the wire to go idle and
+**						then runs the hook. TXIM is masked once the queue
+**						is empty.
+**
+** parameters:			port num
+** Returned value:		None
+** 
+*****************************************************************************/
+static void SSPQueueService( uint32_t portnum )
+{
+  LPC_SSP_TypeDef *ssp = (portnum == 0) ? LPC_SSP0 : LPC_SSP1;
+  uint32_t tail = sspTxqTail[portnum];
+  uint32_t inflight = streamInFlight[portnum];
+  uint32_t entry;
+  uint16_t Dummy = Dummy;
+
+  while ( ssp->SR & SSPSR_RNE )
+  {
+	Dummy = ssp->DR;
+	inflight--;
+  }
+  while ( tail != sspTxqHead[portnum] )
+  {
+	entry = sspTxq[portnum][tail];
+	if ( entry & SSP_TXQ_MARK )
+	{
+	  /* every frame before the mark has to leave the shift register */
+	  while ( inflight )
+	  {
+		if ( ssp->SR & SSPSR_RNE )
+		{
+		  Dummy = ssp->DR;
+		  inflight--;
+		}
+	  }
+	  while ( ssp->SR & SSPSR_BSY );
+	  streamInFlight[portnum] = 0;
+	  if ( sspTxqHook[portnum] )
+	  {
+		sspTxqInHook[portnum] = 1;
+		sspTxqHook[portnum]( entry & 0xFFFF );
+		sspTxqInHook[portnum] = 0;
+	  }
+	}
+	else
+	{
+	  if ( inflight >= FIFOSIZE )
+		break;
+	  ssp->DR = entry;
+	  inflight++;
+	}
+	tail = (tail + 1) & (SSP_TXQ_SIZE - 1);
+  }
+  streamInFlight[portnum] = inflight;
+  sspTxqTail[portnum] = tail;
+  if ( tail == sspTxqHead[portnum] )
+	ssp->IMSC &= ~SSPIMSC_TXIM;
+  return;
+}
+
 /*****************************************************************************
 ** Function name:		SSP_IRQHandler
 **
@@ -58,6 +148,10 @@ void SSP0_IRQHandler(void)
 	interrupt0RxTimeoutStat++;
 	LPC_SSP0->ICR = SSPICR_RTIC;		/* clear interrupt */
   }
+  if ( sspTxqBusy[0] )		/* Tx queue refill, also drains Rx */
+  {
+	SSPQueueService( 0 );
+  }
 
   /* please be aware that, in main and ISR, CurrentRxIndex and CurrentTxIndex
   are shared as global variables. It may create some race condition that main
@@ -99,6 +193,10 @@ void SSP1_IRQHandler(void)
 	interrupt1RxTimeoutStat++;
 	LPC_SSP1->ICR = SSPICR_RTIC;		/* clear interrupt */
   }
+  if ( sspTxqBusy[1] )		/* Tx queue refill, also drains Rx */
+  {
+	SSPQueueService( 1 );
+  }
 
   /* please be aware that, in main and ISR, CurrentRxIndex and CurrentTxIndex
   are shared as global variables. It may create some race condition that main
@@ -169,11 +267,10 @@ void SSP0Init( void )
   LPC_GPIO0->FIODIR |= (0x1<<16);		/* P0.16 defined as GPIO and Outputs */
 #endif
 		
-  /* Set DSS data to 8-bit, Frame format SPI, CPOL = 0, CPHA = 0, and SCR is 15 */
-  LPC_SSP0->CR0 = 0x0707;
-
-  /* SSPCPSR clock prescale register, master mode, minimum divisor is 0x02 */
-  LPC_SSP0->CPSR = 0x2;
+  /* Set DSS data to 8-bit, Frame format SPI, CPOL = 0, CPHA = 0. CPSR and
+  SCR are picked by SSPSetClock for the startup bit rate. */
+  LPC_SSP0->CR0 = 0x0007;
+  SSPSetClock( 0, SSP_SAFE_HZ );
 
   for ( i = 0; i < FIFOSIZE; i++ )
   {
@@ -234,11 +331,10 @@ void SSP1Init( void )
   LPC_GPIO0->FIODIR |= (0x1<<6);		/* P0.6 defined as GPIO and Outputs */
 //#endif
 		
-  /* Set DSS data to 8-bit, Frame format SPI, CPOL = 0, CPHA = 0, and SCR is 15 */
-  LPC_SSP1->CR0 = 0x0707;
-
-  /* SSPCPSR clock prescale register, master mode, minimum divisor is 0x02 */
-  LPC_SSP1->CPSR = 0x2;
+  /* Set DSS data to 8-bit, Frame format SPI, CPOL = 0, CPHA = 0. CPSR and
+  SCR are picked by SSPSetClock for the startup bit rate. */
+  LPC_SSP1->CR0 = 0x0007;
+  SSPSetClock( 1, SSP_SAFE_HZ );
 
   for ( i = 0; i < FIFOSIZE; i++ )
   {
@@ -272,6 +368,287 @@ void SSP1Init( void )
   return;
 }
 
+/*****************************************************************************
+** Function name:		SSPGetPclk
+**
+** Descriptions:		Peripheral clock of the SSP port, from CCLK and the
+**						PCLKSEL divider it was given at startup.
+**
+** parameters:			port num
+** Returned value:		peripheral clock in Hz
+** 
+*****************************************************************************/
+static uint32_t SSPGetPclk( uint32_t portnum )
+{
+  uint32_t sel;
+
+  SystemCoreClockUpdate();
+  if ( portnum == 0 )
+	sel = (LPC_SC->PCLKSEL1 >> 10) & 0x3;
+  else
+	sel = (LPC_SC->PCLKSEL0 >> 20) & 0x3;
+
+  switch ( sel )
+  {
+	case 0:  return SystemCoreClock / 4;
+	case 1:  return SystemCoreClock;
+	case 2:  return SystemCoreClock / 2;
+	default: return SystemCoreClock / 8;
+  }
+}
+
+/*****************************************************************************
+** Function name:		SSPSetClock
+**
+** Descriptions:		Select the fastest SSP bit rate that does not exceed
+**						the requested one. The CPSR/SCR pair with the
+**						smallest overall divider is programmed against the
+**						current peripheral clock. PCLKSEL is left alone:
+**						changing it with PLL0 connected is unreliable
+**						(errata PCLKSELx.1), and CCLK/4 already reaches
+**						the panel's rates. The bit rate is
+**						PCLK / (CPSDVSR * (SCR + 1)).
+**
+** parameters:			port num, target bit rate in Hz
+** Returned value:		bit rate actually programmed in Hz
+** 
+*****************************************************************************/
+uint32_t SSPSetClock( uint32_t portnum, uint32_t bitrate )
+{
+  LPC_SSP_TypeDef *ssp = (portnum == 0) ? LPC_SSP0 : LPC_SSP1;
+  uint32_t pclk, cpsr, scr, div, best_cpsr, best_scr, best_div;
+
+  pclk = SSPGetPclk( portnum );
+  if ( bitrate == 0 )
+	bitrate = 1;
+
+  best_cpsr = SSP_CPSR_MAX;
+  best_scr = SSP_SCR_MAX;
+  best_div = SSP_CPSR_MAX * (SSP_SCR_MAX + 1);
+  for ( cpsr = SSP_CPSR_MIN; cpsr <= SSP_CPSR_MAX; cpsr += 2 )
+  {
+	/* smallest SCR that keeps the bit rate at or below the target */
+	scr = (pclk + cpsr * bitrate - 1) / (cpsr * bitrate);
+	if ( scr > 0 )
+	  scr--;
+	if ( scr > SSP_SCR_MAX )
+	  continue;
+	div = cpsr * (scr + 1);
+	if ( div < best_div )
+	{
+	  best_div = div;
+	  best_cpsr = cpsr;
+	  best_scr = scr;
+	}
+  }
+
+  /* Only change the clock between frames */
+  while ( ssp->SR & SSPSR_BSY );
+
+  ssp->CPSR = best_cpsr;
+  ssp->CR0 = (ssp->CR0 & 0xFF) | (best_scr << 8);
+
+  return pclk / best_div;
+}
+
+/*****************************************************************************
+** Function name:		SSPGetClock
+**
+** Descriptions:		Compute the bit rate the SSP port runs at from
+**						CCLK, its PCLKSEL divider, CPSR and SCR.
+**
+** parameters:			port num
+** Returned value:		bit rate in Hz
+** 
+*****************************************************************************/
+uint32_t SSPGetClock( uint32_t portnum )
+{
+  LPC_SSP_TypeDef *ssp = (portnum == 0) ? LPC_SSP0 : LPC_SSP1;
+
+  return SSPGetPclk( portnum ) / (ssp->CPSR * (((ssp->CR0 >> 8) & 0xFF) + 1));
+}
+
+/*****************************************************************************
+** Function name:		SSPSetFrameSize
+**
+** Descriptions:		Select the number of bits per frame (4 to 16). The
+**						queued frames are flushed first, so the new size
+**						only applies to data written afterwards. With 16-bit
+**						frames one FIFO entry carries a whole RGB565 pixel
+**						or address word, sent MSB first.
+**						From the queue's hook, while a DMA burst is on the
+**						wire, the change is refused (frameSizeRefusedStat).
+**
+** parameters:			port num, bits per frame
+** Returned value:		None
+** 
+*****************************************************************************/
+void SSPSetFrameSize( uint32_t portnum, uint32_t bits )
+{
+  LPC_SSP_TypeDef *ssp = (portnum == 0) ? LPC_SSP0 : LPC_SSP1;
+
+  if ( bits < 4 || bits > 16 )
+	return;
+  if ( (ssp->CR0 & SSPCR0_DSS_MASK) == bits - 1 )
+	return;
+
+  /* never change the frame size under a running DMA burst. The queue's hook
+  runs from the SSP interrupt and cannot wait for the burst to end, so the
+  change is refused and counted there. */
+  if ( portnum == 0 && sspDmaActive )
+  {
+	if ( sspTxqInHook[0] )
+	{
+	  frameSizeRefusedStat++;
+	  return;
+	}
+	while ( sspDmaActive );
+  }
+  SSPStreamFlush( portnum );
+  ssp->CR0 = (ssp->CR0 & ~SSPCR0_DSS_MASK) | (bits - 1);
+  return;
+}
+
+/*****************************************************************************
+** Function name:		SSPQueueSetHook
+**
+** Descriptions:		Install the function that runs for every mark in
+**						the transmit queue of the port, e.g. to switch the
+**						LCD D/C line or the frame size in order with data.
+**
+** parameters:			port num, hook (may be 0)
+** Returned value:		None
+** 
+*****************************************************************************/
+void SSPQueueSetHook( uint32_t portnum, SSP_QueueHook hook )
+{
+  sspTxqHook[portnum] = hook;
+  return;
+}
+
+/*****************************************************************************
+** Function name:		SSPQueuePut
+**
+** Descriptions:		Append one entry to the transmit queue and make sure
+**						the TX interrupt is enabled. Only waits when the
+**						queue is full.
+**
+** parameters:			port num, frame or mark
+** Returned value:		None
+** 
+*****************************************************************************/
+static void SSPQueuePut( uint32_t portnum, uint32_t entry )
+{
+  LPC_SSP_TypeDef *ssp = (portnum == 0) ? LPC_SSP0 : LPC_SSP1;
+  uint32_t head = sspTxqHead[portnum];
+  uint32_t next = (head + 1) & (SSP_TXQ_SIZE - 1);
+
+  /* queue full, the interrupt is emptying it */
+  while ( next == sspTxqTail[portnum] );
+
+  sspTxq[portnum][head] = entry;
+  sspTxqBusy[portnum] = 1;
+  sspTxqHead[portnum] = next;
+  if ( !(ssp->IMSC & SSPIMSC_TXIM) )
+	ssp->IMSC |= SSPIMSC_TXIM;
+  return;
+}
+
+/*****************************************************************************
+** Function name:		SSPQueueFrame
+**
+** Descriptions:		Queue one frame for the interrupt driven transmitter
+**						and return without waiting for it to be sent.
+**
+** parameters:			port num, frame value
+** Returned value:		None
+** 
+*****************************************************************************/
+void SSPQueueFrame( uint32_t portnum, uint16_t frame )
+{
+  SSPQueuePut( portnum, frame );
+  return;
+}
+
+/*****************************************************************************
+** Function name:		SSPQueueSend
+**
+** Descriptions:		Queue a block of 8-bit frames.
+**
+** parameters:			port num, buffer pointer, and the block length
+** Returned value:		None
+** 
+*****************************************************************************/
+void SSPQueueSend( uint32_t portnum, const uint8_t *buf, uint32_t Length )
+{
+  while ( Length-- )
+	SSPQueuePut( portnum, *buf++ );
+  return;
+}
+
+/*****************************************************************************
+** Function name:		SSPQueueSend16
+**
+** Descriptions:		Queue a block of 16-bit frames.
+**
+** parameters:			port num, halfword buffer pointer, number of halfwords
+** Returned value:		None
+** 
+*****************************************************************************/
+void SSPQueueSend16( uint32_t portnum, const uint16_t *buf, uint32_t Length )
+{
+  while ( Length-- )
+	SSPQueuePut( portnum, *buf++ );
+  return;
+}
+
+/*****************************************************************************
+** Function name:		SSPQueueMark
+**
+** Descriptions:		Queue a mark. When the interrupt reaches it, every
+**						frame queued before has been sent and the hook set
+**						by SSPQueueSetHook() runs with arg, before any frame
+**						queued after it goes out.
+**
+** parameters:			port num, hook argument
+** Returned value:		None
+** 
+*****************************************************************************/
+void SSPQueueMark( uint32_t portnum, uint16_t arg )
+{
+  SSPQueuePut( portnum, SSP_TXQ_MARK | arg );
+  return;
+}
+
+/*****************************************************************************
+** Function name:		SSPQueueFence
+**
+** Descriptions:		Wait until everything queued has left the shift
+**						register and give the RX FIFO back to polled code.
+**						Call it before SSPSend(), the DMA API,
+**						SSPSetFrameSize() or any change of SSEL or D/C that
+**						is not made through a mark.
+**
+** parameters:			port num
+** Returned value:		None
+** 
+*****************************************************************************/
+void SSPQueueFence( uint32_t portnum )
+{
+  IRQn_Type irq = (portnum == 0) ? SSP0_IRQn : SSP1_IRQn;
+
+  if ( !sspTxqBusy[portnum] )
+	return;
+
+  while ( sspTxqTail[portnum] != sspTxqHead[portnum] );
+
+  NVIC_DisableIRQ( irq );
+  SSPStreamFlush( portnum );
+  sspTxqBusy[portnum] = 0;
+  NVIC_EnableIRQ( irq );
+  return;
+}
+
 /*****************************************************************************
 ** Function name:		SSPSend
 **
@@ -328,6 +705,258 @@ void SSPSend( uint32_t portnum, uint8_t *buf, uint32_t Length )
   return; 
 }
 
+/*****************************************************************************
+** Function name:		SSPStreamFlush
+**
+** Descriptions:		Wait until every frame the queue pushed has left the
+**						shift register and drain the matching RX bytes.
+**
+** parameters:			port num
+** Returned value:		None
+** 
+*****************************************************************************/
+void SSPStreamFlush( uint32_t portnum )
+{
+  LPC_SSP_TypeDef *ssp = (portnum == 0) ? LPC_SSP0 : LPC_SSP1;
+  uint32_t inflight = streamInFlight[portnum];
+  uint8_t Dummy = Dummy;
+
+  while ( inflight )
+  {
+	if ( ssp->SR & SSPSR_RNE )
+	{
+	  Dummy = ssp->DR;
+	  inflight--;
+	}
+  }
+  while ( ssp->SR & SSPSR_BSY );
+  streamInFlight[portnum] = 0;
+  return;
+}
+
+/*****************************************************************************
+** Function name:		DMA_IRQHandler
+**
+** Descriptions:		GPDMA interrupt handler. On terminal count of the
+**						SSP0 channel it waits for the last frames to leave
+**						the shift register, drains the RX FIFO that filled
+**						up during the transfer and runs the completion
+**						callback of the finished burst.
+**
+** parameters:			None
+** Returned value:		None
+** 
+*****************************************************************************/
+void DMA_IRQHandler(void)
+{
+  SSP_DMACallback callback;
+  uint8_t Dummy = Dummy;
+
+  if ( !(LPC_GPDMA->DMACIntStat & (1 << SSP_DMA_CHANNEL)) )
+	return;
+
+  if ( LPC_GPDMA->DMACIntErrStat & (1 << SSP_DMA_CHANNEL) )
+  {
+	/* the channel has stopped, finish the burst as if it completed */
+	dmaErrorStat++;
+	LPC_GPDMA->DMACIntErrClr = (1 << SSP_DMA_CHANNEL);
+  }
+  /* only the last item of a chain has its I bit set */
+  LPC_GPDMA->DMACIntTCClear = (1 << SSP_DMA_CHANNEL);
+
+  while ( LPC_SSP0->SR & SSPSR_BSY );
+  while ( LPC_SSP0->SR & SSPSR_RNE )
+	Dummy = LPC_SSP0->DR;
+  LPC_SSP0->ICR = SSPICR_RORIC;
+  LPC_SSP0->DMACR &= ~SSPDMACR_TXDMAE;
+  LPC_SSP0->IMSC |= SSPIMSC_RORIM;
+
+  callback = sspDmaCallback;
+  sspDmaCallback = 0;
+  sspDmaActive = 0;
+  if ( callback )
+	callback();
+  return;
+}
+
+/*****************************************************************************
+** Function name:		SSP0DMAInit
+**
+** Descriptions:		Power up the GPDMA and reserve SSP_DMA_CHANNEL for
+**						memory to SSP0 TX transfers. SSP0Init() must have
+**						been called first.
+**
+** parameters:			None
+** Returned value:		None
+** 
+*****************************************************************************/
+void SSP0DMAInit( void )
+{
+  /* Enable AHB clock to the GPDMA. */
+  LPC_SC->PCONP |= (0x1<<29);
+
+  LPC_GPDMA->DMACIntTCClear = (1 << SSP_DMA_CHANNEL);
+  LPC_GPDMA->DMACIntErrClr = (1 << SSP_DMA_CHANNEL);
+  SSP_DMA_CH->DMACCConfig = 0;
+
+  /* Enable the controller, little-endian on both AHB masters */
+  LPC_GPDMA->DMACConfig = 0x01;
+  while ( !(LPC_GPDMA->DMACConfig & 0x01) );
+
+  sspDmaActive = 0;
+  NVIC_EnableIRQ(DMA_IRQn);
+  return;
+}
+
+/*****************************************************************************
+** Function name:		SSP0DMAFrameBytes
+**
+** Descriptions:		Bytes of memory the GPDMA reads per SSP0 frame at
+**						the current frame size.
+**
+** parameters:			None
+** Returned value:		1 for frames up to 8 bits, 2 for wider frames
+** 
+*****************************************************************************/
+static uint32_t SSP0DMAFrameBytes( void )
+{
+  return ( (LPC_SSP0->CR0 & SSPCR0_DSS_MASK) > 7 ) ? 2 : 1;
+}
+
+/*****************************************************************************
+** Function name:		SSP0DMALink
+**
+** Descriptions:		Fill one linked-list item that moves Length bytes
+**						(at most SSP_DMA_MAX_XFER frames) from buf to the
+**						SSP0 data register, then continues with next (0
+**						ends the chain and raises the completion interrupt).
+**						The item is built for the frame size SSP0 has now:
+**						with frames wider than 8 bits buf holds halfwords,
+**						one per frame, and Length must be even.
+**
+** parameters:			descriptor, buffer pointer, block length, next descriptor
+** Returned value:		None
+** 
+*****************************************************************************/
+void SSP0DMALink( SSP_DMA_LLI *lli, const uint8_t *buf, uint32_t Length, SSP_DMA_LLI *next )
+{
+  lli->SrcAddr = (uint32_t)buf;
+  lli->DstAddr = (uint32_t)&LPC_SSP0->DR;
+  lli->NextLLI = (uint32_t)next;
+  if ( SSP0DMAFrameBytes() == 2 )
+	lli->Control = ((Length >> 1) & SSP_DMA_MAX_XFER) | DMACC_SBSIZE_4 | DMACC_DBSIZE_4
+			| DMACC_SWIDTH_16 | DMACC_DWIDTH_16 | DMACC_SI;
+  else
+	lli->Control = (Length & SSP_DMA_MAX_XFER) | DMACC_SBSIZE_4 | DMACC_DBSIZE_4
+			| DMACC_SWIDTH_8 | DMACC_DWIDTH_8 | DMACC_SI;
+  if ( next == 0 )
+	lli->Control |= DMACC_I;
+  return;
+}
+
+/*****************************************************************************
+** Function name:		SSP0DMASendList
+**
+** Descriptions:		Start a GPDMA transfer of a descriptor chain to
+**						SSP0 and return at once. The caller owns SSEL and
+**						D/C until the callback runs from DMA_IRQHandler.
+**
+** parameters:			first descriptor, completion callback (may be 0)
+** Returned value:		1 if the transfer was started, 0 if the engine is busy
+** 
+*****************************************************************************/
+uint32_t SSP0DMASendList( SSP_DMA_LLI *list, SSP_DMACallback callback )
+{
+  if ( sspDmaActive )
+	return 0;
+
+  /* Make sure queued and polled traffic is finished and RX is empty before
+  the DMA takes over, overruns during the burst are expected and not counted.
+  The engine is only marked busy afterwards: a mark still in the queue may
+  change the frame size, which waits for the engine to be idle. */
+  SSPQueueFence( 0 );
+  SSPStreamFlush( 0 );
+
+  sspDmaActive = 1;
+  sspDmaCallback = callback;
+  LPC_SSP0->IMSC &= ~SSPIMSC_RORIM;
+
+  LPC_GPDMA->DMACIntTCClear = (1 << SSP_DMA_CHANNEL);
+  LPC_GPDMA->DMACIntErrClr = (1 << SSP_DMA_CHANNEL);
+  SSP_DMA_CH->DMACCSrcAddr = list->SrcAddr;
+  SSP_DMA_CH->DMACCDestAddr = list->DstAddr;
+  SSP_DMA_CH->DMACCLLI = list->NextLLI;
+  SSP_DMA_CH->DMACCControl = list->Control;
+
+  LPC_SSP0->DMACR |= SSPDMACR_TXDMAE;
+  SSP_DMA_CH->DMACCConfig = DMACCFG_E | DMACCFG_DESTPERIPH(SSP0_DMA_TX_CONN)
+			| DMACCFG_M2P | DMACCFG_IE | DMACCFG_ITC;
+  return 1;
+}
+
+/*****************************************************************************
+** Function name:		SSP0DMASendRepeat
+**
+** Descriptions:		Send Length bytes made of back-to-back copies of
+**						block by chaining items that all point at it. The
+**						last item sends only the head of block, so block
+**						should hold whole pixels.
+**
+** parameters:			block pointer, block length, total length, callback
+** Returned value:		1 if the transfer was started, 0 otherwise
+** 
+*****************************************************************************/
+uint32_t SSP0DMASendRepeat( const uint8_t *block, uint32_t BlockLength, uint32_t Length, SSP_DMACallback callback )
+{
+  uint32_t i, n, chunk;
+
+  if ( Length == 0 || BlockLength == 0 || sspDmaActive
+	|| BlockLength > SSP_DMA_MAX_XFER * SSP0DMAFrameBytes() )
+	return 0;
+
+  n = (Length + BlockLength - 1) / BlockLength;
+  if ( n > SSP_DMA_LLI_POOL )
+	return 0;
+
+  for ( i = 0; i < n; i++ )
+  {
+	chunk = (Length > BlockLength) ? BlockLength : Length;
+	SSP0DMALink( &sspDmaPool[i], block, chunk, (i + 1 < n) ? &sspDmaPool[i + 1] : 0 );
+	Length -= chunk;
+  }
+  return SSP0DMASendList( sspDmaPool, callback );
+}
+
+/*****************************************************************************
+** Function name:		SSP0DMABusy
+**
+** Descriptions:		Check whether a DMA burst is still on the wire.
+**
+** parameters:			None
+** Returned value:		1 while a transfer is in progress, else 0
+** 
+*****************************************************************************/
+uint32_t SSP0DMABusy( void )
+{
+  return sspDmaActive;
+}
+
+/*****************************************************************************
+** Function name:		SSP0DMAWait
+**
+** Descriptions:		Block until the current DMA burst and its callback
+**						have finished.
+**
+** parameters:			None
+** Returned value:		None
+** 
+*****************************************************************************/
+void SSP0DMAWait( void )
+{
+  while ( sspDmaActive );
+  return;
+}
+
 /*****************************************************************************
 ** Function name:		SSPSendReceive
 ** Descriptions:		the module will receive a block of data from
@@ -46,6 +46,20 @@
 #define DELAY_COUNT		10
 #define MAX_TIMEOUT		0xFF
 
+/* Interrupt driven transmit queue, SSP_TXQ_SIZE must be a power of 2. An
+entry is a frame, or a mark that runs the queue hook in order with data. */
+#define SSP_TXQ_SIZE	256
+#define SSP_TXQ_MARK	(1UL << 16)
+
+/* SSP clock prescaler limits, CPSDVSR must be even */
+#define SSP_CPSR_MIN	2
+#define SSP_CPSR_MAX	254
+#define SSP_SCR_MAX		255
+
+/* Bit rate SSPxInit starts the ports at, slow enough for any device on the
+bus. Raise it with SSPSetClock once the device is set up. */
+#define SSP_SAFE_HZ		1000000
+
 /* Port0.2 is the SSP select pin */
 #define SSP0_SEL		(1 << 2)
 	
@@ -58,6 +72,7 @@
 
 /* SSP CR0 register */
 #define SSPCR0_DSS		(1 << 0)
+#define SSPCR0_DSS_MASK	(0xF << 0)		/* frame size - 1 */
 #define SSPCR0_FRF		(1 << 4)
 #define SSPCR0_SPO		(1 << 6)
 #define SSPCR0_SPH		(1 << 7)
@@ -91,6 +106,50 @@
 #define SSPICR_RORIC	(1 << 0)
 #define SSPICR_RTIC		(1 << 1)
 
+/* SSP DMA control register */
+#define SSPDMACR_RXDMAE	(1 << 0)
+#define SSPDMACR_TXDMAE	(1 << 1)
+
+/* GPDMA channel feeding SSP0 TX. The GPDMA can only reach the AHB SRAM
+banks, so every buffer and descriptor handed to it must live in RamAHB32. */
+#define SSP_DMA_CHANNEL		0
+#define SSP_DMA_CH			LPC_GPDMACH0
+#define SSP0_DMA_TX_CONN	0			/* GPDMA peripheral number of SSP0 Tx */
+#define SSP_DMA_MAX_XFER	0xFFF		/* TransferSize is a 12-bit field */
+#define SSP_DMA_LLI_POOL	80
+
+/* GPDMA channel control register */
+#define DMACC_SBSIZE_4		(1 << 12)
+#define DMACC_DBSIZE_4		(1 << 15)
+#define DMACC_SWIDTH_8		(0 << 18)
+#define DMACC_DWIDTH_8		(0 << 21)
+#define DMACC_SWIDTH_16		(1 << 18)
+#define DMACC_DWIDTH_16		(1 << 21)
+#define DMACC_SI			(1 << 26)
+#define DMACC_DI			(1 << 27)
+#define DMACC_I				(1UL << 31)
+
+/* GPDMA channel configuration register */
+#define DMACCFG_E			(1 << 0)
+#define DMACCFG_DESTPERIPH(n)	((n) << 6)
+#define DMACCFG_M2P			(1 << 11)
+#define DMACCFG_IE			(1 << 14)
+#define DMACCFG_ITC			(1 << 15)
+#define DMACCFG_A			(1 << 17)
+
+/* One GPDMA linked-list item, the layout is fixed by the hardware */
+typedef struct SSP_DMA_LLI
+{
+  uint32_t SrcAddr;
+  uint32_t DstAddr;
+  uint32_t NextLLI;
+  uint32_t Control;
+} SSP_DMA_LLI;
+
+typedef void (*SSP_DMACallback)( void );
+
+typedef void (*SSP_QueueHook)( uint32_t arg );
+
 /* ATMEL SEEPROM command set */
 #define WREN		0x06		/* MSB A8 is set to 0, simplifying test */
 #define WRDI		0x04
@@ -113,6 +172,23 @@ extern void SSP1Init( void );
 extern void SSP2Init( void );
 extern void SSPSend( uint32_t portnum, uint8_t *Buf, uint32_t Length );
 extern void SSPReceive( uint32_t portnum, uint8_t *buf, uint32_t Length );
+extern uint32_t SSPSetClock( uint32_t portnum, uint32_t bitrate );
+extern uint32_t SSPGetClock( uint32_t portnum );
+extern void SSPStreamFlush( uint32_t portnum );
+extern void SSPSetFrameSize( uint32_t portnum, uint32_t bits );
+extern void SSPQueueSetHook( uint32_t portnum, SSP_QueueHook hook );
+extern void SSPQueueFrame( uint32_t portnum, uint16_t frame );
+extern void SSPQueueSend( uint32_t portnum, const uint8_t *buf, uint32_t Length );
+extern void SSPQueueSend16( uint32_t portnum, const uint16_t *buf, uint32_t Length );
+extern void SSPQueueMark( uint32_t portnum, uint16_t arg );
+extern void SSPQueueFence( uint32_t portnum );
+extern void DMA_IRQHandler( void );
+extern void SSP0DMAInit( void );
+extern void SSP0DMALink( SSP_DMA_LLI *lli, const uint8_t *buf, uint32_t Length, SSP_DMA_LLI *next );
+extern uint32_t SSP0DMASendList( SSP_DMA_LLI *list, SSP_DMACallback callback );
+extern uint32_t SSP0DMASendRepeat( const uint8_t *block, uint32_t BlockLength, uint32_t Length, SSP_DMACallback callback );
+extern uint32_t SSP0DMABusy( void );
+extern void SSP0DMAWait( void );
 uint8_t SSP1SendReceive(uint8_t out);	//only for SSP1
 #endif  /* __SSP_H__ */
 /*****************************************************************************